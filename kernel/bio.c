@@ -18,6 +18,7 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "riscv.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
@@ -30,7 +31,10 @@ struct {
   // Sorted by how recently the buffer was used.
   // head.next is most recent, head.prev is least.
   struct buf head;
-} bcache;
+
+  uint hit;   // bget()s that found the block cached
+  uint miss;  // and that recycled a buffer
+} __attribute__((aligned(CACHELINE))) bcache;
 
 void binit(void) {
   struct buf *b;
@@ -60,6 +64,7 @@ static struct buf *bget(uint dev, uint blockno) {
   // Is the block already cached?
   for (b = bcache.head.next; b != &bcache.head; b = b->next) {
     if (b->dev == dev && b->blockno == blockno) {
+      bcache.hit++;
       b->refcnt++;
       release(&bcache.lock);
       acquiresleep(&b->lock);
@@ -69,6 +74,7 @@ static struct buf *bget(uint dev, uint blockno) {
 
   // Not cached.
   // Recycle the least recently used (LRU) unused buffer.
+  bcache.miss++;
   for (b = bcache.head.prev; b != &bcache.head; b = b->prev) {
     if (b->refcnt == 0) {
       b->dev = dev;
@@ -86,9 +92,11 @@ static struct buf *bget(uint dev, uint blockno) {
 // Return a locked buf with the contents of the indicated block.
 struct buf *bread(uint dev, uint blockno) {
   struct buf *b;
+  struct proc *p;
 
   b = bget(dev, blockno);
   if (!b->valid) {
+    if ((p = myproc()) != 0) p->ru.inblock++;
     virtio_disk_rw(b, 0);
     b->valid = 1;
   }
@@ -97,7 +105,10 @@ struct buf *bread(uint dev, uint blockno) {
 
 // Write b's contents to disk.  Must be locked.
 void bwrite(struct buf *b) {
+  struct proc *p;
+
   if (!holdingsleep(&b->lock)) panic("bwrite");
+  if ((p = myproc()) != 0) p->ru.oublock++;
   virtio_disk_rw(b, 1);
 }
 
@@ -134,3 +145,9 @@ void bunpin(struct buf *b) {
   b->refcnt--;
   release(&bcache.lock);
 }
+
+// Report bget() hits and misses.
+void bstats(uint *hit, uint *miss) {
+  *hit = bcache.hit;
+  *miss = bcache.miss;
+}
@@ -1,12 +1,14 @@
+// A block in the buffer cache. bget() scans the first part
+// of every buf under bcache.lock; the lock holder's data is
+// in lines of its own.
 struct buf {
-  int valid;   // has data been read from disk?
-  int disk;    // does disk "own" buf?
   uint dev;
   uint blockno;
-  struct sleeplock lock;
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
-  uchar data[BSIZE];
+  int valid;   // has data been read from disk?
+  int disk;    // does disk "own" buf?
+  struct sleeplock lock;
+  uchar data[BSIZE] __attribute__((aligned(CACHELINE)));
 };
-
@@ -50,7 +50,7 @@ struct {
   uint r;  // Read index
   uint w;  // Write index
   uint e;  // Edit index
-} cons;
+} __attribute__((aligned(CACHELINE))) cons;
 
 //
 // user write()s to the console go here.
@@ -124,7 +124,7 @@ int consoleread(int user_dst, uint64 dst, int n) {
 
 //
 // the console input interrupt handler.
-// uartintr() calls this for input character.
+// uartbh() calls this for input character.
 // do erase/kill processing, append to cons.buf,
 // wake up consoleread() if a whole line has arrived.
 //
@@ -6,8 +6,13 @@ struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct spawnact;
 struct stat;
+struct stats;
+struct shrinker;
 struct superblock;
+struct timer;
+struct work;
 
 // bio.c
 void            binit(void);
@@ -16,6 +21,7 @@ void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+void            bstats(uint*, uint*);
 
 // console.c
 void            consoleinit(void);
@@ -24,6 +30,7 @@ void            consputc(int);
 
 // exec.c
 int             exec(char*, char**);
+int             execproc(struct proc*, char*, char**);
 
 // file.c
 struct file*    filealloc(void);
@@ -45,6 +52,7 @@ void            ilock(struct inode*);
 void            iput(struct inode*);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
+int             iused(void);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
@@ -61,11 +69,17 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kalloc_pages(int);
+uint            kfreepages(void);
+void            kfreeblocks(uint*);
 void            kfree(void *);
+void            kfree_pages(void*, int);
 void            kinit(void);
+void            register_shrinker(struct shrinker*);
 
 // log.c
 void            initlog(int, struct superblock*);
+uint            logcommits(void);
 void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
@@ -85,16 +99,26 @@ void            _printf(const char*, unsigned int, char*, ... );
 void            _printf(char*, ... );
 #endif
 void            panic(char*) __attribute__((noreturn));
-void            printfinit(void);
+int             klogc(void);
+int             klogread(uint64, int);
 
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             spawn(char*, char**, struct spawnact*, int);
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
+int             setaffinity(int, uint64);
+int             getaffinity(int, uint64*);
+int             isolate(uint64);
+int             settickets(int, int);
+int             setgroup(int, int);
+int             setshare(int, int);
+int             setrt(int, int, int);
+int             rtcheck(void);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -104,12 +128,18 @@ void            sched(void);
 void            setproc(struct proc*);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
+struct proc*    kthread(char*, void (*)(void*), void*, uint64);
 int             wait(uint64);
 void            wakeup(void*);
+void            wakeproc(struct proc*, void*);
+void            account(struct proc*, int);
+uint64          procpages(struct proc*);
+int             overlimit(struct proc*, uint64);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
+void            procstats(struct stats*);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -119,6 +149,7 @@ void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
+int             tryacquire(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
@@ -145,18 +176,43 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// sysfile.c
+struct file*    fileopen(char*, int);
+
+// timer.c
+void            wheelinit(void);
+void            timer_add(struct timer*, uint);
+int             timer_del(struct timer*);
+void            timertick(void);
+int             timer_sleep(uint);
+
+// softirq.c
+void            raise_softirq(int);
+void            softirq(void);
+
+// workqueue.c
+void            workinit(void);
+void            workerinit(void);
+int             queue_work(struct work*);
+int             queue_delayed_work(struct work*, uint);
+int             cancel_delayed_work(struct work*);
+uint            workdone(int);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            clockat(uint64);
 
 // uart.c
 void            uartinit(void);
 void            uartintr(void);
+void            uartbh(void);
 void            uartputc(int);
 void            uartputc_sync(int);
+void            uartkick(void);
 int             uartgetc(void);
 
 // vm.c
@@ -173,21 +229,37 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+int             uvmfault(struct proc*, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
+void            uvmusage(pagetable_t, uint64 *, uint64 *);
+uint64          uvmptcost(pagetable_t, uint64, uint64);
+
+// ipi.c
+void            ipiintr(void);
+void            xcall(int, void (*)(void*), void*);
+int             ipi_kick(uint64);
+void            ipi_resched(int);
+int             tlbremote(pagetable_t);
+void            tlbshootdown(pagetable_t);
 
 // plic.c
 void            plicinit(void);
 void            plicinithart(void);
 int             plic_claim(void);
 void            plic_complete(int);
+int             plic_setaffinity(int, uint);
+void            plic_steer(int);
+void            plic_counts(int, uint*);
 
 // virtio_disk.c
 void            virtio_disk_init(void);
 void            virtio_disk_rw(struct buf *, int);
 void            virtio_disk_intr(void);
+void            virtio_disk_bh(void);
+void            diskstats(uint*, uint*);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
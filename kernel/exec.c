@@ -9,7 +9,12 @@
 
 static int loadseg(pde_t *pgdir, uint64 addr, struct inode *ip, uint offset, uint sz);
 
-int exec(char *path, char **argv) {
+int exec(char *path, char **argv) { return execproc(myproc(), path, argv); }
+
+// Replace p's user memory with the program at path.
+// p is the current process, or, for spawn(), a new
+// child that has not run yet.
+int execproc(struct proc *p, char *path, char **argv) {
   char *s, *last;
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG + 1], stackbase;
@@ -17,7 +22,6 @@ int exec(char *path, char **argv) {
   struct inode *ip;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  struct proc *p = myproc();
 
   begin_op();
 
@@ -39,9 +43,12 @@ int exec(char *path, char **argv) {
     if (ph.type != ELF_PROG_LOAD) continue;
     if (ph.memsz < ph.filesz) goto bad;
     if (ph.vaddr + ph.memsz < ph.vaddr) goto bad;
+    // only the part from the file is allocated now; the
+    // rest, the bss, is zero-filled on demand (uvmfault()).
     uint64 sz1;
-    if ((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0) goto bad;
+    if ((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.filesz)) == 0 && ph.vaddr + ph.filesz != 0) goto bad;
     sz = sz1;
+    if (ph.vaddr + ph.memsz > sz) sz = ph.vaddr + ph.memsz;
     if (ph.vaddr % PGSIZE != 0) goto bad;
     if (loadseg(pagetable, ph.vaddr, ip, ph.off, ph.filesz) < 0) goto bad;
   }
@@ -49,7 +56,6 @@ int exec(char *path, char **argv) {
   end_op();
   ip = 0;
 
-  p = myproc();
   uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
@@ -96,6 +102,7 @@ int exec(char *path, char **argv) {
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp;          // initial stack pointer
   proc_freepagetable(oldpagetable, oldsz);
+  procpages(p);
 
   return argc;  // this ends up in a0, the first argument to main(argc, argv)
 
@@ -17,7 +17,7 @@ struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
   struct file file[NFILE];
-} ftable;
+} __attribute__((aligned(CACHELINE))) ftable;
 
 void fileinit(void) { initlock(&ftable.lock, "ftable"); }
 
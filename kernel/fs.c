@@ -163,7 +163,7 @@ static void bfree(int dev, uint b) {
 struct {
   struct spinlock lock;
   struct inode inode[NINODE];
-} icache;
+} __attribute__((aligned(CACHELINE))) icache;
 
 void iinit() {
   int i = 0;
@@ -252,6 +252,17 @@ static struct inode *iget(uint dev, uint inum) {
   return ip;
 }
 
+// Return how many in-memory inodes are in use.
+int iused(void) {
+  int n = 0;
+
+  acquire(&icache.lock);
+  for (int i = 0; i < NINODE; i++)
+    if (icache.inode[i].ref > 0) n++;
+  release(&icache.lock);
+  return n;
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode *idup(struct inode *ip) {
@@ -0,0 +1,131 @@
+//
+// inter-processor interrupts.
+//
+// S-mode can't interrupt another hart itself. the sender sets
+// a bit in the target's pending word and writes the target's
+// CLINT MSIP register; timervec in kernelvec.S turns the
+// machine-mode software interrupt into a supervisor one, and
+// devintr() calls ipiintr().
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "defs.h"
+
+#define IPI_RESCHED 1  // a process became RUNNABLE; leave wfi, or see ipi_resched()
+#define IPI_CALL 2     // run the cross-call in ipis[hart]
+
+struct {
+  uint64 pending;        // IPI_ bits not yet handled
+  int busy;              // a sender owns fn and arg
+  void (*fn)(void *);    // cross-call to run
+  void *arg;
+  volatile int done;     // fn has returned
+} __attribute__((aligned(CACHELINE))) ipis[NCPU];
+
+static void send(int hart, int bit) {
+  __sync_fetch_and_or(&ipis[hart].pending, bit);
+  *(uint32 *)CLINT_MSIP(hart) = 1;
+}
+
+// handle this hart's pending IPIs.
+// interrupts must be disabled.
+void ipiintr(void) {
+  int hart = cpuid();
+  uint64 bits = __sync_fetch_and_and(&ipis[hart].pending, 0);
+
+  // IPI_RESCHED needs nothing more: the interrupt has
+  // already brought the scheduler out of wfi.
+  if (bits & IPI_CALL) {
+    ipis[hart].fn(ipis[hart].arg);
+    __sync_synchronize();
+    ipis[hart].done = 1;
+  }
+}
+
+// run fn(arg) on hart, with interrupts off, and wait for it
+// to return. a hart waiting here runs cross-calls sent to it,
+// so two harts calling each other can't deadlock.
+void xcall(int hart, void (*fn)(void *), void *arg) {
+  push_off();
+  if (hart == cpuid()) {
+    fn(arg);
+    pop_off();
+    return;
+  }
+  while (__sync_lock_test_and_set(&ipis[hart].busy, 1) != 0) ipiintr();
+  ipis[hart].fn = fn;
+  ipis[hart].arg = arg;
+  ipis[hart].done = 0;
+  send(hart, IPI_CALL);
+  while (!ipis[hart].done) ipiintr();
+  __sync_lock_release(&ipis[hart].busy);
+  pop_off();
+}
+
+// a process has become RUNNABLE; bring one idle hart of
+// those in mask, if any, out of wfi to run it. returns 0
+// if none was idle.
+int ipi_kick(uint64 mask) {
+  struct cpu *c;
+  int kicked = 0;
+
+  push_off();
+  __sync_synchronize();
+  for (c = cpus; c < &cpus[NCPU]; c++) {
+    if (c != mycpu() && c->idle && (mask & (1UL << (c - cpus)))) {
+      // so the next wakeup kicks a different hart.
+      c->idle = 0;
+      send(c - cpus, IPI_RESCHED);
+      kicked = 1;
+      break;
+    }
+  }
+  pop_off();
+  return kicked;
+}
+
+// a real-time process has become RUNNABLE and should run on
+// hart ahead of what it is running; make it switch at its
+// next interrupt (see rtcheck()).
+void ipi_resched(int hart) {
+  cpus[hart].resched = 1;
+  push_off();
+  if (hart == cpuid())
+    w_sip(r_sip() | 2);
+  else
+    send(hart, IPI_RESCHED);
+  pop_off();
+}
+
+static void flushtlb(void *arg) { sfence_vma(); }
+
+// return 1 if some other hart may have pagetable's
+// translations in its TLB: it is running a process with
+// that page table in user space. the kernel flushes the TLB
+// when it switches satp, so no other hart can have them.
+int tlbremote(pagetable_t pagetable) {
+  struct proc *p;
+  int i, remote = 0;
+
+  push_off();
+  for (i = 0; i < NCPU; i++) {
+    if (i != cpuid() && (p = cpus[i].proc) != 0 && p->pagetable == pagetable) remote = 1;
+  }
+  pop_off();
+  return remote;
+}
+
+// flush pagetable's translations from the TLBs of the other
+// harts that may hold them, and wait until they have.
+void tlbshootdown(pagetable_t pagetable) {
+  struct proc *p;
+
+  for (int i = 0; i < NCPU; i++) {
+    if ((p = cpus[i].proc) != 0 && p->pagetable == pagetable) xcall(i, flushtlb, 0);
+  }
+}
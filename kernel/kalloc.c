@@ -1,30 +1,80 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
-// and pipe buffers. Allocates whole 4096-byte pages.
+// and pipe buffers. kalloc_pages() allocates a physically
+// contiguous block of 2^order pages, aligned to its size;
+// kalloc() allocates one 4096-byte page.
+//
+// A buddy allocator: each free block is on the list for its
+// order. Allocating splits a bigger block if need be, and
+// freeing merges a block with its buddy, the other half of
+// the block of the next order up, while that is free too.
+//
+// Subsystems holding memory they can give back register a
+// shrinker. kalloc() runs the shrinkers itself before failing,
+// when it safely can, and queues reclaim work once free pages
+// drop below KMEMLOW; that runs them until KMEMHIGH.
 
 #include "types.h"
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
 #include "riscv.h"
+#include "proc.h"
+#include "timer.h"
+#include "work.h"
+#include "shrinker.h"
 #include "defs.h"
 
 void freerange(void *pa_start, void *pa_end);
+static void reclaim(struct work *w);
 
 extern char end[];  // first address after kernel.
                     // defined by kernel.ld.
 
+#define NPAGE ((PHYSTOP - KERNBASE) / PGSIZE)
+
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
 struct {
   struct spinlock lock;
-  struct run *freelist;
-} kmem;
+  struct run free[KMAXORDER + 1];  // circular lists of free blocks, by order
+  uint nblock[KMAXORDER + 1];      // blocks on each
+  uchar order[NPAGE];              // 1 + order of the free block a page heads, or 0
+  uint nfree;                      // free pages
+  struct shrinker *shrinkers;
+  struct work reclaim;
+} __attribute__((aligned(CACHELINE))) kmem = {.reclaim = {.fn = reclaim}};
+
+static uint pgno(void *pa) { return ((uint64)pa - KERNBASE) / PGSIZE; }
+
+static struct run *pgaddr(uint i) { return (struct run *)(KERNBASE + (uint64)i * PGSIZE); }
+
+// caller holds kmem.lock.
+static void push(struct run *r, int order) {
+  struct run *head = &kmem.free[order];
+
+  r->next = head->next;
+  r->prev = head;
+  head->next->prev = r;
+  head->next = r;
+  kmem.order[pgno(r)] = order + 1;
+  kmem.nblock[order]++;
+}
+
+// caller holds kmem.lock.
+static void unlink(struct run *r, int order) {
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.order[pgno(r)] = 0;
+  kmem.nblock[order]--;
+}
 
 void kinit() {
   initlock(&kmem.lock, "kmem");
+  for (int k = 0; k <= KMAXORDER; k++) kmem.free[k].next = kmem.free[k].prev = &kmem.free[k];
   freerange(end, (void *)PHYSTOP);
 }
 
@@ -34,37 +84,132 @@ void freerange(void *pa_start, void *pa_end) {
   for (; p + PGSIZE <= (char *)pa_end; p += PGSIZE) kfree(p);
 }
 
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
-void kfree(void *pa) {
-  struct run *r;
+// Free the block of 2^order pages at pa, which normally
+// should have been returned by kalloc_pages(order). (The
+// exception is when initializing the allocator; see kinit
+// above.)
+void kfree_pages(void *pa, int order) {
+  uint i, buddy;
 
-  if (((uint64)pa % PGSIZE) != 0 || (char *)pa < end || (uint64)pa >= PHYSTOP) panic("kfree");
+  if (order < 0 || order > KMAXORDER || ((uint64)pa % (PGSIZE << order)) != 0 || (char *)pa < end ||
+      (uint64)pa + (PGSIZE << order) > PHYSTOP)
+    panic("kfree");
 
   // Fill with junk to catch dangling refs.
-  memset(pa, 1, PGSIZE);
+  memset(pa, 1, PGSIZE << order);
 
-  r = (struct run *)pa;
+  i = pgno(pa);
+  acquire(&kmem.lock);
+  kmem.nfree += 1 << order;
+  for (; order < KMAXORDER; order++) {
+    buddy = i ^ (1 << order);
+    if (buddy >= NPAGE || kmem.order[buddy] != order + 1) break;
+    unlink(pgaddr(buddy), order);
+    i &= ~(1 << order);
+  }
+  push(pgaddr(i), order);
+  release(&kmem.lock);
+}
+
+// Free the page of physical memory pointed at by v,
+// which normally should have been returned by a
+// call to kalloc().
+void kfree(void *pa) { kfree_pages(pa, 0); }
+
+// Take a block of 2^order pages off the free lists, splitting
+// a bigger one if need be, or return 0. Sets *low if that
+// took free pages below KMEMLOW.
+static struct run *take(int order, int *low) {
+  struct run *r = 0;
+  int k;
 
   acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
+  for (k = order; k <= KMAXORDER && kmem.free[k].next == &kmem.free[k]; k++)
+    ;
+  if (k <= KMAXORDER) {
+    r = kmem.free[k].next;
+    unlink(r, k);
+    // give back the upper half of each split.
+    while (k > order) {
+      k--;
+      push((struct run *)((char *)r + (PGSIZE << k)), k);
+    }
+    *low = kmem.nfree >= KMEMLOW && kmem.nfree - (1 << order) < KMEMLOW;
+    kmem.nfree -= 1 << order;
+  } else {
+    *low = 0;
+  }
   release(&kmem.lock);
+  return r;
 }
 
-// Allocate one 4096-byte page of physical memory.
-// Returns a pointer that the kernel can use.
+// Ask the shrinkers for up to n pages; returns pages freed.
+static int shrink(int n) {
+  struct shrinker *s;
+  int got, freed = 0;
+
+  for (s = kmem.shrinkers; s && freed < n; s = s->next) {
+    got = s->scan(n - freed);
+    __sync_fetch_and_add(&s->freed, got);
+    freed += got;
+  }
+  return freed;
+}
+
+// Shrinkers take locks of their own, so kalloc() only runs
+// them itself when its caller holds none.
+static int canshrink(void) {
+  int ok;
+
+  push_off();
+  ok = mycpu()->noff == 1;
+  pop_off();
+  return ok;
+}
+
+// Allocate 2^order physically contiguous pages, aligned to
+// their size. Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
-void *kalloc(void) {
+void *kalloc_pages(int order) {
   struct run *r;
+  int low;
+
+  if (order < 0 || order > KMAXORDER) return 0;
+  r = take(order, &low);
+  if (r == 0 && canshrink() && shrink(1 << order) > 0) r = take(order, &low);
+  if (r == 0 || low) queue_work(&kmem.reclaim);
+
+  if (r) memset((char *)r, 5, PGSIZE << order);  // fill with junk
+  return (void *)r;
+}
 
+// Allocate one 4096-byte page of physical memory.
+void *kalloc(void) { return kalloc_pages(0); }
+
+// Reclaim work: queued when free pages drop below KMEMLOW,
+// or kalloc() fails, it shrinks until there are KMEMHIGH or
+// the shrinkers have nothing left.
+static void reclaim(struct work *w) {
+  while (kmem.nfree < KMEMHIGH && shrink(KMEMHIGH - kmem.nfree) > 0)
+    ;
+}
+
+// Add s to the shrinkers kalloc() runs under pressure.
+void register_shrinker(struct shrinker *s) {
   acquire(&kmem.lock);
-  r = kmem.freelist;
-  if (r) kmem.freelist = r->next;
+  s->next = kmem.shrinkers;
+  kmem.shrinkers = s;
   release(&kmem.lock);
+}
 
-  if (r) memset((char *)r, 5, PGSIZE);  // fill with junk
-  return (void *)r;
+// Return the number of free pages.
+uint kfreepages(void) { return kmem.nfree; }
+
+// Copy the number of free blocks of each order to
+// nblock[0..KMAXORDER]. Free memory in many small blocks
+// and few big ones is fragmented.
+void kfreeblocks(uint *nblock) {
+  acquire(&kmem.lock);
+  for (int k = 0; k <= KMAXORDER; k++) nblock[k] = kmem.nblock[k];
+  release(&kmem.lock);
 }
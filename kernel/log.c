@@ -44,8 +44,9 @@ struct log {
   int outstanding;  // how many FS sys calls are executing.
   int committing;   // in commit(), please wait.
   int dev;
+  uint ncommit;  // transactions committed
   struct logheader lh;
-};
+} __attribute__((aligned(CACHELINE)));
 struct log log;
 
 static void recover_from_log(void);
@@ -178,6 +179,7 @@ static void commit() {
     install_trans();  // Now install writes to home locations
     log.lh.n = 0;
     write_head();  // Erase the transaction from the log
+    log.ncommit++;
   }
 }
 
@@ -208,3 +210,6 @@ void log_write(struct buf *b) {
   }
   release(&log.lock);
 }
+
+// Return how many transactions have been committed.
+uint logcommits(void) { return log.ncommit; }
@@ -20,6 +20,8 @@ void main() {
     kvminithart();       // turn on paging
     procinit();          // process table
     trapinit();          // trap vectors
+    wheelinit();         // per-CPU timer wheels
+    workinit();          // per-CPU work queues
     trapinithart();      // install kernel trap vector
     plicinit();          // set up interrupt controller
     plicinithart();      // ask PLIC for device interrupts
@@ -28,6 +30,7 @@ void main() {
     fileinit();          // file table
     virtio_disk_init();  // emulated hard disk
     userinit();          // first user process
+    workerinit();        // this hart's kworker thread
     __sync_synchronize();
     started = 1;
   } else {
@@ -38,6 +41,7 @@ void main() {
     kvminithart();   // turn on paging
     trapinithart();  // install kernel trap vector
     plicinithart();  // ask PLIC for device interrupts
+    workerinit();    // this hart's kworker thread
   }
 
   scheduler();
@@ -11,3 +11,8 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NGROUP        8   // scheduling groups
+#define KMEMLOW      64    // free pages below which reclaim work is queued
+#define KMEMHIGH     256   // free pages reclaim work tries to get back to
+#define KMAXORDER    10    // kalloc_pages() blocks are up to 2^KMAXORDER pages
+#define CACHELINE    64    // bytes; data written by different harts goes in different lines
@@ -2,13 +2,66 @@
 #include "param.h"
 #include "memlayout.h"
 #include "riscv.h"
+#include "spinlock.h"
 #include "defs.h"
 
 //
 // the riscv Platform Level Interrupt Controller (PLIC).
 //
 
+// which harts each device IRQ is delivered to. a pinned IRQ
+// goes to the harts in its mask. an unpinned one goes to every
+// hart, except the disk's, which goes to the hart that last
+// submitted a request: the completion then runs where the buf
+// is cache-hot, and the other harts don't race it to the claim.
+struct {
+  struct spinlock lock;
+  uint harts;       // harts that have called plicinithart()
+  uint pin[NIRQ];   // affinity mask, or 0 if unpinned
+  int diskhart;     // where an unpinned disk IRQ goes
+} __attribute__((aligned(CACHELINE))) plic;
+
+// claims by hart and IRQ; IRQ 0 counts claims that found
+// nothing because another hart got there first.
+uint irqcount[NCPU][NIRQ] __attribute__((aligned(CACHELINE)));
+
+static int irqs[] = {UART0_IRQ, VIRTIO0_IRQ};
+
+// should irq be delivered to hart?
+static int routed(int irq, int hart) {
+  return plic.pin[irq] ? (plic.pin[irq] >> hart & 1) : irq != VIRTIO0_IRQ || plic.diskhart == hart;
+}
+
+// the enable bits for hart. exact if the caller holds plic.lock.
+static uint32 enables(int hart) {
+  uint32 e = 0;
+
+  for (int i = 0; i < NELEM(irqs); i++)
+    if (routed(irqs[i], hart)) e |= 1 << irqs[i];
+  return e;
+}
+
+// reprogram every running hart's enables. caller holds plic.lock.
+// another hart may be serving an IRQ routed away from it, and
+// the PLIC ignores completions of IRQs that are not enabled,
+// which would leave the IRQ masked for good. so other harts
+// only gain enables here; each drops its own stale ones in
+// plic_complete(), when it has nothing in service. this hart
+// has nothing in service, its interrupts being off.
+static void route(void) {
+  int me = cpuid();
+  volatile uint32 *e;
+
+  for (int hart = 0; hart < NCPU; hart++) {
+    if ((plic.harts >> hart & 1) == 0) continue;
+    e = (uint32 *)PLIC_SENABLE(hart);
+    *e = hart == me ? enables(hart) : *e | enables(hart);
+  }
+}
+
 void plicinit(void) {
+  initlock(&plic.lock, "plic");
+
   // set desired IRQ priorities non-zero (otherwise disabled).
   *(uint32 *)(PLIC + UART0_IRQ * 4) = 1;
   *(uint32 *)(PLIC + VIRTIO0_IRQ * 4) = 1;
@@ -17,22 +70,74 @@ void plicinit(void) {
 void plicinithart(void) {
   int hart = cpuid();
 
-  // set uart's enable bit for this hart's S-mode.
-  *(uint32 *)PLIC_SENABLE(hart) = (1 << UART0_IRQ) | (1 << VIRTIO0_IRQ);
+  // set this hart's S-mode enable bits.
+  acquire(&plic.lock);
+  plic.harts |= 1 << hart;
+  *(uint32 *)PLIC_SENABLE(hart) = enables(hart);
+  release(&plic.lock);
 
   // set this hart's S-mode priority threshold to 0.
   *(uint32 *)PLIC_SPRIORITY(hart) = 0;
 }
 
+// deliver irq only to the harts in mask, or if mask is 0,
+// as by default.
+int plic_setaffinity(int irq, uint mask) {
+  int i;
+
+  for (i = 0; i < NELEM(irqs); i++)
+    if (irqs[i] == irq) break;
+  if (i == NELEM(irqs)) return -1;
+
+  acquire(&plic.lock);
+  if (mask & ~plic.harts) {
+    release(&plic.lock);
+    return -1;
+  }
+  plic.pin[irq] = mask;
+  route();
+  release(&plic.lock);
+  return 0;
+}
+
+// send the next interrupt from an unpinned irq to this
+// hart. called by a driver when it starts a request.
+void plic_steer(int irq) {
+  int hart = cpuid();
+
+  // racy peek; the common case is nothing to do.
+  if (plic.pin[irq] || plic.diskhart == hart) return;
+  acquire(&plic.lock);
+  if (plic.pin[irq] == 0) {
+    plic.diskhart = hart;
+    route();
+  }
+  release(&plic.lock);
+}
+
+// copy irq's per-hart claim counts to counts[0..NCPU).
+void plic_counts(int irq, uint *counts) {
+  for (int hart = 0; hart < NCPU; hart++) counts[hart] = irqcount[hart][irq];
+}
+
 // ask the PLIC what interrupt we should serve.
 int plic_claim(void) {
   int hart = cpuid();
   int irq = *(uint32 *)PLIC_SCLAIM(hart);
+  if (irq < NIRQ) irqcount[hart][irq]++;
   return irq;
 }
 
 // tell the PLIC we've served this IRQ.
 void plic_complete(int irq) {
   int hart = cpuid();
+
   *(uint32 *)PLIC_SCLAIM(hart) = irq;
+
+  // drop enables that route() left here; the racy peek is
+  // usually enough.
+  if (*(volatile uint32 *)PLIC_SENABLE(hart) == enables(hart)) return;
+  acquire(&plic.lock);
+  *(uint32 *)PLIC_SENABLE(hart) = enables(hart);
+  release(&plic.lock);
 }
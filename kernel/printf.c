@@ -17,15 +17,52 @@
 
 volatile int panicked = 0;
 
-// lock to avoid interleaving concurrent printf's.
+// kernel messages go into klog, a ring holding the latest
+// KLOGSIZE bytes. uartstart() drains it to the console as
+// fast as the UART takes them, and dmesg() reads it.
+//
+// printf() formats a message into a buffer on its stack,
+// reserves space in the ring with an atomic add, copies the
+// message in, and publishes it once every printf() that
+// reserved space before it has, so messages stay whole and
+// in order without a lock, and no hart waits on the UART.
+// only a printf() that finds the ring drained starts the
+// UART; the UART interrupt sends the rest. a message longer
+// than a line goes out in pieces. after a panic, output is
+// synchronous.
+#define KLOGSIZE 16384
+
 static struct {
-  struct spinlock lock;
-  int locking;
-} pr;
+  char buf[KLOGSIZE];
+  uint64 head;       // next byte to reserve
+  uint64 committed;  // bytes before this are complete
+  uint64 sent;       // bytes before this went to the UART
+  int sync;          // panicking: write straight to the UART
+} __attribute__((aligned(CACHELINE))) klog;
+
+// a message being formatted.
+struct line {
+  char buf[256];
+  int n;
+};
 
 static char digits[] = "0123456789abcdef";
 
-static void printint(int xx, int base, int sign) {
+static void klogwrite(struct line *l);
+
+static void lputc(struct line *l, int c) {
+  if (l->n == sizeof(l->buf)) {
+    klogwrite(l);
+    l->n = 0;
+  }
+  l->buf[l->n++] = c;
+}
+
+static void lputs(struct line *l, const char *s) {
+  while (*s) lputc(l, *s++);
+}
+
+static void printint(struct line *l, int xx, int base, int sign) {
   char buf[16];
   int i;
   uint x;
@@ -42,14 +79,71 @@ static void printint(int xx, int base, int sign) {
 
   if (sign) buf[i++] = '-';
 
-  while (--i >= 0) consputc(buf[i]);
+  while (--i >= 0) lputc(l, buf[i]);
 }
 
-static void printptr(uint64 x) {
+static void printptr(struct line *l, uint64 x) {
   int i;
-  consputc('0');
-  consputc('x');
-  for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4) consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
+  lputc(l, '0');
+  lputc(l, 'x');
+  for (i = 0; i < (sizeof(uint64) * 2); i++, x <<= 4) lputc(l, digits[x >> (sizeof(uint64) * 8 - 4)]);
+}
+
+// append l to klog, and start the UART if it had sent
+// everything before l.
+static void klogwrite(struct line *l) {
+  uint64 pos;
+  int i;
+
+  if (klog.sync) {
+    for (i = 0; i < l->n; i++) consputc(l->buf[i]);
+    return;
+  }
+
+  push_off();
+  pos = __sync_fetch_and_add(&klog.head, l->n);
+  for (i = 0; i < l->n; i++) klog.buf[(pos + i) % KLOGSIZE] = l->buf[i];
+  while (__atomic_load_n(&klog.committed, __ATOMIC_ACQUIRE) != pos)
+    ;
+  __atomic_store_n(&klog.committed, pos + l->n, __ATOMIC_RELEASE);
+  pop_off();
+
+  // pairs with the fence in klogc(): either the UART's
+  // sender sees l, or this sees that it had caught up.
+  __sync_synchronize();
+  if (__atomic_load_n(&klog.sent, __ATOMIC_RELAXED) == pos) uartkick();
+}
+
+// return the next klog byte for the UART, or -1 if there
+// is none. caller holds uart_tx_lock, or is panicking.
+int klogc(void) {
+  uint64 committed, sent = klog.sent;
+
+  __sync_synchronize();
+  committed = __atomic_load_n(&klog.committed, __ATOMIC_ACQUIRE);
+  if (sent == committed) return -1;
+  // if printf() has lapped the UART, skip what was lost.
+  if (committed - sent > KLOGSIZE) sent = committed - KLOGSIZE;
+  __atomic_store_n(&klog.sent, sent + 1, __ATOMIC_RELAXED);
+  return klog.buf[sent % KLOGSIZE] & 0xff;
+}
+
+// copy the last n or fewer bytes of klog to user address
+// dst. returns the number copied.
+int klogread(uint64 dst, int n) {
+  uint64 end = __atomic_load_n(&klog.committed, __ATOMIC_ACQUIRE);
+  uint64 pos = end > KLOGSIZE ? end - KLOGSIZE : 0;
+  int m;
+
+  if (n < 0) return -1;
+  if (end - pos > n) pos = end - n;
+  for (n = 0; pos < end; pos += m, n += m) {
+    // up to the end of the ring, then from its start.
+    m = KLOGSIZE - pos % KLOGSIZE;
+    if (m > end - pos) m = end - pos;
+    if (copyout(myproc()->pagetable, dst + n, klog.buf + pos % KLOGSIZE, m) < 0) return -1;
+  }
+  return n;
 }
 
 // Print to the console. only understands %d, %x, %p, %s.
@@ -60,78 +154,68 @@ _printf(const char *filename, unsigned int line, char *fmt, ...)
 _printf(char *fmt, ...)
 #endif
 {
-#ifdef TEST
-  static const char *file_color = "\033[0;36m";
-  static const char *line_color = ":\033[0;35m";
-  static const char *content_color = "\t\033[0;32m";
-  static const char *rst_str = "\033[0m";
-#endif
   va_list ap;
-  int i, c, locking;
+  int i, c;
   char *s;
-
-  locking = pr.locking;
-  if (locking) acquire(&pr.lock);
+  struct line l;
 
   if (fmt == 0) panic("null fmt");
 
+  l.n = 0;
 #ifdef TEST
-  for (i = 0; file_color[i] != 0; i++) {
-    consputc(file_color[i]);
-  }
-  for (i = 0; filename[i] != 0; i++) {
-    consputc(filename[i]);
-  }
-  for (i = 0; line_color[i] != 0; i++) {
-    consputc(line_color[i]);
-  }
-  printint(line, 10, 1);
-  for (i = 0; content_color[i] != 0; i++) {
-    consputc(content_color[i]);
-  }
+  lputs(&l, "\033[0;36m");
+  lputs(&l, filename);
+  lputs(&l, ":\033[0;35m");
+  printint(&l, line, 10, 1);
+  lputs(&l, "\t\033[0;32m");
 #endif
   va_start(ap, fmt);
   for (i = 0; (c = fmt[i] & 0xff) != 0; i++) {
     if (c != '%') {
-      consputc(c);
+      lputc(&l, c);
       continue;
     }
     c = fmt[++i] & 0xff;
     if (c == 0) break;
     switch (c) {
       case 'd':
-        printint(va_arg(ap, int), 10, 1);
+        printint(&l, va_arg(ap, int), 10, 1);
         break;
       case 'x':
-        printint(va_arg(ap, int), 16, 1);
+        printint(&l, va_arg(ap, int), 16, 1);
         break;
       case 'p':
-        printptr(va_arg(ap, uint64));
+        printptr(&l, va_arg(ap, uint64));
         break;
       case 's':
         if ((s = va_arg(ap, char *)) == 0) s = "(null)";
-        for (; *s; s++) consputc(*s);
+        lputs(&l, s);
         break;
       case '%':
-        consputc('%');
+        lputc(&l, '%');
         break;
       default:
         // Print unknown % sequence to draw attention.
-        consputc('%');
-        consputc(c);
+        lputc(&l, '%');
+        lputc(&l, c);
         break;
     }
   }
 #ifdef TEST
-  for (i = 0; rst_str[i] != 0; i++) {
-    consputc(rst_str[i]);
-  }
+  lputs(&l, "\033[0m");
 #endif
-  if (locking) release(&pr.lock);
+  klogwrite(&l);
 }
 
 void panic(char *s) {
-  pr.locking = 0;
+  int c;
+
+  // write out what the UART hasn't sent yet, then switch to
+  // synchronous output. this takes no lock, since the panic
+  // may be about one; the UART may get a byte twice.
+  while ((c = klogc()) >= 0) uartputc_sync(c);
+  klog.sync = 1;
+
   printf("panic: ");
   printf(s);
   printf("\n");
@@ -139,8 +223,3 @@ void panic(char *s) {
   for (;;)
     ;
 }
-
-void printfinit(void) {
-  initlock(&pr.lock, "pr");
-  pr.locking = 1;
-}
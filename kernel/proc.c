@@ -5,6 +5,9 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
+#include "spawn.h"
+#include "stats.h"
+#include "shrinker.h"
 
 struct cpu cpus[NCPU];
 
@@ -12,12 +15,58 @@ struct proc proc[NPROC];
 
 struct proc *initproc;
 
+// how long a process woken onto a busy hart waits for it
+// before another hart may take it: about what moving to a
+// cold cache costs.
+#define MIGRATECOST (TIMEFREQ / 2000)
+
+uint64 harts;     // harts that have started scheduler()
+uint64 isolated;  // harts left to pinned processes
+
+// stride scheduling, in two levels: groups share the CPU in
+// proportion to their tickets, and the processes in a group
+// share what it gets in proportion to theirs. each runs the
+// one with the lowest pass, which grows by the CPU time it
+// uses times STRIDE1 / tickets.
+#define STRIDE1 (1 << 16)
+#define DEFTICKETS 100
+#define MAXTICKETS 10000
+
+struct group {
+  int used;        // has members, or is group 0
+  int nproc;       // members, until freeproc()
+  int tickets;     // share of the CPU against other groups
+  uint64 pass;     // CPU time used / tickets
+  uint64 vtime;    // pass of the member switched to last
+  uint64 runtime;  // time CSR ticks its members have run
+} __attribute__((aligned(CACHELINE))) groups[NGROUP];
+
+struct spinlock group_lock __attribute__((aligned(CACHELINE)));
+uint64 gvtime;  // pass of the group switched to last
+
+// real-time processes, admitted by setrt(), run ahead of all
+// others, earliest deadline first. each may use rtbudget of
+// CPU time per rtperiod, and once it has is throttled until
+// the period ends. admission keeps their total share under
+// RTUTIL per mille of one hart, so they meet their deadlines
+// even if all are pinned to the same one.
+#define RTUTIL 700
+#define RTMAXPERIOD 10000000  // microseconds
+
+struct spinlock rt_lock __attribute__((aligned(CACHELINE)));
+uint rtutil;  // per mille of a hart admitted
+
 int nextpid = 1;
-struct spinlock pid_lock;
+struct spinlock pid_lock __attribute__((aligned(CACHELINE)));
 
 extern void forkret(void);
 static void wakeup1(struct proc *chan);
 static void freeproc(struct proc *p);
+static int shrinkzombies(int n);
+static void switched(void);
+static uint utilof(uint64 period, uint64 budget);
+
+static struct shrinker zombies = {.name = "zombies", .scan = shrinkzombies};
 
 extern char trampoline[];  // trampoline.S
 
@@ -26,6 +75,10 @@ void procinit(void) {
   struct proc *p;
 
   initlock(&pid_lock, "nextpid");
+  initlock(&group_lock, "group");
+  initlock(&rt_lock, "rt");
+  groups[0].used = 1;
+  groups[0].tickets = DEFTICKETS;
   for (p = proc; p < &proc[NPROC]; p++) {
     initlock(&p->lock, "proc");
 
@@ -39,6 +92,7 @@ void procinit(void) {
     p->kstack = va;
   }
   kvminithart();
+  register_shrinker(&zombies);
 }
 
 // Must be called with interrupts disabled,
@@ -66,6 +120,30 @@ struct proc *myproc(void) {
   return p;
 }
 
+// caller holds group_lock.
+static void join(struct proc *p, int gid) {
+  p->group = gid;
+  p->pass = groups[gid].vtime;
+  groups[gid].nproc++;
+}
+
+// caller holds group_lock.
+static void leave(struct proc *p) {
+  struct group *g = &groups[p->group];
+
+  if (--g->nproc == 0 && g != &groups[0]) g->used = 0;
+}
+
+// Put child np in p's group, with p's tickets and pass.
+static void inherit(struct proc *np, struct proc *p) {
+  acquire(&group_lock);
+  leave(np);
+  join(np, p->group);
+  release(&group_lock);
+  np->tickets = p->tickets;
+  np->pass = p->pass;
+}
+
 int allocpid() {
   int pid;
 
@@ -78,10 +156,10 @@ int allocpid() {
 }
 
 // Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
-static struct proc *allocproc(void) {
+// If found, mark it USED, initialize state required to run
+// in the kernel, and return with p->lock held.
+// If there are no free procs, return 0.
+static struct proc *allocslot(void) {
   struct proc *p;
 
   for (p = proc; p < &proc[NPROC]; p++) {
@@ -96,9 +174,38 @@ static struct proc *allocproc(void) {
 
 found:
   p->pid = allocpid();
+  p->state = USED;
+  memset(&p->ru, 0, sizeof(p->ru));
+  memset(&p->cru, 0, sizeof(p->cru));
+  p->rlimit.cur = p->rlimit.max = RLIM_INFINITY;
+  p->kfn = 0;
+  p->cpu = cpuid();
+  p->affinity = ~0UL;
+  p->tickets = DEFTICKETS;
+  p->rtperiod = p->rtbudget = p->rtdeadline = p->rtleft = 0;
+  acquire(&group_lock);
+  join(p, 0);
+  release(&group_lock);
+
+  // Set up new context to start executing at forkret,
+  // which returns to user space.
+  memset(&p->context, 0, sizeof(p->context));
+  p->context.ra = (uint64)forkret;
+  p->context.sp = p->kstack + PGSIZE;
+
+  return p;
+}
+
+// allocslot(), plus a trapframe and an empty user page table.
+// If there are no free procs, or a memory allocation fails, return 0.
+static struct proc *allocproc(void) {
+  struct proc *p;
+
+  if ((p = allocslot()) == 0) return 0;
 
   // Allocate a trapframe page.
   if ((p->trapframe = (struct trapframe *)kalloc()) == 0) {
+    freeproc(p);
     release(&p->lock);
     return 0;
   }
@@ -111,19 +218,85 @@ found:
     return 0;
   }
 
-  // Set up new context to start executing at forkret,
-  // which returns to user space.
-  memset(&p->context, 0, sizeof(p->context));
-  p->context.ra = (uint64)forkret;
-  p->context.sp = p->kstack + PGSIZE;
+  return p;
+}
+
+// a kernel thread's first scheduling by scheduler()
+// will swtch to kthreadret.
+static void kthreadret(void) {
+  struct proc *p = myproc();
 
+  // Still holding p->lock from scheduler() or sched().
+  switched();
+  release(&p->lock);
+  p->kfn(p->karg);
+  panic("kthread returned");
+}
+
+// Start a kernel thread running fn(arg) on the harts in
+// affinity: a process with no user memory, which never
+// returns to user space or exits.
+struct proc *kthread(char *name, void (*fn)(void *), void *arg, uint64 affinity) {
+  struct proc *p;
+
+  if ((p = allocslot()) == 0) panic("kthread");
+  p->kfn = fn;
+  p->karg = arg;
+  p->affinity = affinity;
+  p->context.ra = (uint64)kthreadret;
+  safestrcpy(p->name, name, sizeof(p->name));
+  p->state = RUNNABLE;
+  release(&p->lock);
   return p;
 }
 
+// shrinker: free the user memory of zombies whose parents have
+// not wait()ed for them yet. wait() only needs their xstate and
+// rusage, and freeproc() skips what is already gone.
+static int shrinkzombies(int n) {
+  struct proc *p;
+  struct trapframe *tf;
+  pagetable_t pagetable;
+  uint64 sz, rss, ptpages;
+  int freed = 0;
+
+  for (p = proc; p < &proc[NPROC] && freed < n; p++) {
+    acquire(&p->lock);
+    tf = 0;
+    pagetable = 0;
+    sz = 0;
+    if (p->state == ZOMBIE) {
+      tf = p->trapframe;
+      pagetable = p->pagetable;
+      sz = p->sz;
+      p->trapframe = 0;
+      p->pagetable = 0;
+      p->sz = 0;
+    }
+    release(&p->lock);
+
+    if (tf) {
+      kfree((void *)tf);
+      freed++;
+    }
+    if (pagetable) {
+      // most of sz may never have been touched; count what
+      // is mapped, less the trapframe, freed above.
+      uvmusage(pagetable, &rss, &ptpages);
+      proc_freepagetable(pagetable, sz);
+      freed += rss - 1 + ptpages;
+    }
+  }
+  return freed;
+}
+
 // free a proc structure and the data hanging from it,
 // including user pages.
 // p->lock must be held.
 static void freeproc(struct proc *p) {
+  acquire(&group_lock);
+  leave(p);
+  release(&group_lock);
   if (p->trapframe) kfree((void *)p->trapframe);
   p->trapframe = 0;
   if (p->pagetable) proc_freepagetable(p->pagetable, p->sz);
@@ -210,18 +383,22 @@ void userinit(void) {
 // Grow or shrink user memory by n bytes.
 // Return 0 on success, -1 on failure.
 int growproc(int n) {
-  uint sz;
+  uint64 sz;
   struct proc *p = myproc();
 
   sz = p->sz;
   if (n > 0) {
-    if ((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
-      return -1;
-    }
+    // the pages are allocated when first written (uvmfault()),
+    // but refuse more than could ever be, or the limit allows.
+    uint npages = (PGROUNDUP(sz + n) - PGROUNDUP(sz)) / PGSIZE;
+    if (sz + n > TRAPFRAME || npages > kfreepages()) return -1;
+    if (overlimit(p, npages + uvmptcost(p->pagetable, sz, sz + n))) return -1;
+    sz += n;
   } else if (n < 0) {
     sz = uvmdealloc(p->pagetable, sz, sz + n);
   }
   p->sz = sz;
+  procpages(p);
   return 0;
 }
 
@@ -232,6 +409,10 @@ int fork(void) {
   struct proc *np;
   struct proc *p = myproc();
 
+  // the child starts out holding what p does, under the
+  // same limit.
+  if (overlimit(p, 0)) return -1;
+
   // Allocate process.
   if ((np = allocproc()) == 0) {
     return -1;
@@ -244,6 +425,10 @@ int fork(void) {
     return -1;
   }
   np->sz = p->sz;
+  np->rlimit = p->rlimit;
+  np->affinity = p->affinity;
+  inherit(np, p);
+  procpages(np);
 
   np->parent = p;
 
@@ -269,6 +454,82 @@ int fork(void) {
   return pid;
 }
 
+// Create a child running the program at path, without copying
+// the caller's memory only to throw it away, as fork() followed
+// by exec() does. The child starts with the caller's open files
+// and current directory, after the file actions act[0..nact)
+// have been applied to its file table.
+// Returns the child's pid, or -1, leaving no child behind.
+int spawn(char *path, char **argv, struct spawnact *act, int nact) {
+  int i, fd, pid, argc;
+  struct file *f;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  // as for fork(), a parent over its RLIMIT_RSS can't start
+  // children.
+  if (overlimit(p, 0)) return -1;
+
+  if ((np = allocproc()) == 0) {
+    return -1;
+  }
+  // np is USED, so neither allocproc() nor the scheduler
+  // will touch it; drop the lock, since loading the program
+  // sleeps.
+  release(&np->lock);
+
+  for (i = 0; i < NOFILE; i++)
+    if (p->ofile[i]) np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = idup(p->cwd);
+  np->rlimit = p->rlimit;
+  np->affinity = p->affinity;
+  inherit(np, p);
+
+  for (i = 0; i < nact; i++) {
+    fd = act[i].fd;
+    if (fd < 0 || fd >= NOFILE) goto bad;
+    f = 0;
+    if (act[i].op == SPAWN_DUP) {
+      if (act[i].arg < 0 || act[i].arg >= NOFILE || np->ofile[act[i].arg] == 0) goto bad;
+      f = filedup(np->ofile[act[i].arg]);
+    } else if (act[i].op == SPAWN_OPEN) {
+      if ((f = fileopen(act[i].path, act[i].arg)) == 0) goto bad;
+    } else if (act[i].op != SPAWN_CLOSE) {
+      goto bad;
+    }
+    if (np->ofile[fd]) fileclose(np->ofile[fd]);
+    np->ofile[fd] = f;
+  }
+
+  memset(np->trapframe, 0, sizeof(*np->trapframe));
+  if ((argc = execproc(np, path, argv)) < 0) goto bad;
+  np->trapframe->a0 = argc;
+
+  acquire(&np->lock);
+  np->parent = p;
+  pid = np->pid;
+  np->state = RUNNABLE;
+  release(&np->lock);
+
+  return pid;
+
+bad:
+  for (i = 0; i < NOFILE; i++) {
+    if (np->ofile[i]) {
+      fileclose(np->ofile[i]);
+      np->ofile[i] = 0;
+    }
+  }
+  begin_op();
+  iput(np->cwd);
+  end_op();
+  np->cwd = 0;
+  acquire(&np->lock);
+  freeproc(np);
+  release(&np->lock);
+  return -1;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void reparent(struct proc *p) {
@@ -346,6 +607,12 @@ void exit(int status) {
   // Parent might be sleeping in wait().
   wakeup1(original_parent);
 
+  // give back its real-time share.
+  acquire(&rt_lock);
+  rtutil -= utilof(p->rtperiod, p->rtbudget);
+  release(&rt_lock);
+  p->rtperiod = 0;
+
   p->xstate = status;
   p->state = ZOMBIE;
 
@@ -358,6 +625,43 @@ void exit(int status) {
 
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
+static void addrusage(struct rusage *to, struct rusage *from) {
+  to->utime += from->utime;
+  to->stime += from->stime;
+  to->nvcsw += from->nvcsw;
+  to->nivcsw += from->nivcsw;
+  to->nfault += from->nfault;
+  to->inblock += from->inblock;
+  to->oublock += from->oublock;
+  to->nsyscall += from->nsyscall;
+  if (from->maxrss > to->maxrss) to->maxrss = from->maxrss;
+}
+
+// Pages p holds, in RLIMIT_RSS terms; notes the most it
+// has held in its rusage.
+uint64 procpages(struct proc *p) {
+  uint64 rss, ptpages;
+
+  uvmusage(p->pagetable, &rss, &ptpages);
+  if (rss + ptpages > p->ru.maxrss) p->ru.maxrss = rss + ptpages;
+  return rss + ptpages;
+}
+
+// Would p be over its RLIMIT_RSS holding n more pages?
+int overlimit(struct proc *p, uint64 n) { return (procpages(p) + n) * PGSIZE > p->rlimit.cur; }
+
+// Charge the time since p->tstamp to p's user time, or if
+// user is 0, to its system time.
+void account(struct proc *p, int user) {
+  uint64 now = r_time();
+
+  if (user)
+    p->ru.utime += now - p->tstamp;
+  else
+    p->ru.stime += now - p->tstamp;
+  p->tstamp = now;
+}
+
 int wait(uint64 addr) {
   struct proc *np;
   int havekids, pid;
@@ -387,6 +691,8 @@ int wait(uint64 addr) {
             release(&p->lock);
             return -1;
           }
+          addrusage(&p->cru, &np->ru);
+          addrusage(&p->cru, &np->cru);
           freeproc(np);
           release(&np->lock);
           release(&p->lock);
@@ -407,49 +713,215 @@ int wait(uint64 addr) {
   }
 }
 
+// The harts p may run on: those it is pinned to, or if it
+// is not pinned, any but the isolated ones.
+static uint64 hartsfor(struct proc *p) { return p->affinity == ~0UL ? ~isolated : p->affinity; }
+
+static int allowed(struct proc *p, int hart) { return (hartsfor(p) >> hart) & 1; }
+
+// Is p being kept for another hart than me? See makeready().
+static int kept(struct proc *p, int me) {
+  return p->cpu != me && cpus[p->cpu].wakee == p && r_time() - p->readyat < MIGRATECOST;
+}
+
+static int rt(struct proc *p) { return p->rtperiod != 0; }
+
+// Per mille of a hart that budget every period uses.
+static uint utilof(uint64 period, uint64 budget) { return period ? (budget * 1000 + period - 1) / period : 0; }
+
+// The deadline p would have if it ran at now: the end of its
+// period, or of the next one if that has ended, or a period
+// from now if it has none yet.
+static uint64 deadline(struct proc *p, uint64 now) {
+  if (now < p->rtdeadline) return p->rtdeadline;
+  if (p->rtdeadline != 0 && now < p->rtdeadline + p->rtperiod) return p->rtdeadline + p->rtperiod;
+  return now + p->rtperiod;
+}
+
+// Has p used up its budget for this period?
+static int throttled(struct proc *p, uint64 now) { return rt(p) && p->rtleft == 0 && now < p->rtdeadline; }
+
+static int ready(struct proc *p, int me, uint64 now) {
+  return p->state == RUNNABLE && allowed(p, me) && !throttled(p, now);
+}
+
+// Start p's next period, with a full budget, if this one has
+// ended.
+static void refill(struct proc *p, uint64 now) {
+  if (rt(p) && now >= p->rtdeadline) {
+    p->rtdeadline = deadline(p, now);
+    p->rtleft = p->rtbudget;
+  }
+}
+
+// The earlier of two times, where 0 is never.
+static uint64 sooner(uint64 a, uint64 b) { return a == 0 || (b != 0 && b < a) ? b : a; }
+
+// Ask for a timer interrupt on c at its next real-time
+// event: p, about to run, using up its budget or reaching
+// its deadline, or a throttled process's period ending.
+static void arm(struct cpu *c, struct proc *p) {
+  uint64 at = c->rtwake;
+
+  if (p && rt(p)) at = sooner(sooner(at, p->runstart + p->rtleft), p->rtdeadline);
+  c->rtat = at;
+  clockat(at);
+}
+
+// Charge p, which is on this hart, for the time since it
+// was switched to.
+static void charge(struct proc *p) {
+  struct group *g = &groups[p->group];
+  uint64 now = r_time(), t = now - p->runstart;
+
+  p->runstart = now;
+  p->pass += t * (STRIDE1 / p->tickets);
+  __sync_fetch_and_add(&g->pass, t * (STRIDE1 / g->tickets));
+  __sync_fetch_and_add(&g->runtime, t);
+  if (rt(p)) {
+    p->rtleft -= t < p->rtleft ? t : p->rtleft;
+    refill(p, now);
+  }
+}
+
+// Should a run before b? Real-time processes first, by
+// earliest deadline; then the lower group pass, then the
+// lower pass within a group.
+static int before(struct proc *a, struct proc *b) {
+  struct group *ga = &groups[a->group], *gb = &groups[b->group];
+  uint64 now;
+
+  if (rt(a) != rt(b)) return rt(a);
+  if (rt(a)) {
+    now = r_time();
+    return deadline(a, now) < deadline(b, now);
+  }
+  if (ga != gb) return ga->pass < gb->pass;
+  return a->pass < b->pass;
+}
+
+// Find the RUNNABLE process that should run next, and
+// return it locked, or 0. Of equals, one that last ran on
+// this hart comes first, for its warm cache, and then the
+// first looking round the table from the one after from.
+// The caller may hold another process's lock, so this only
+// tries each lock and passes over busy ones. Notes in
+// c->rtwake when the first throttled process may run again.
+static struct proc *pick(struct proc *from) {
+  struct proc *p, *best;
+  struct cpu *c = mycpu();
+  char busy[NPROC];
+  int me = cpuid();
+  uint64 now = r_time();
+
+  memset(busy, 0, sizeof(busy));
+  for (;;) {
+    best = 0;
+    c->rtwake = 0;
+    p = from;
+    for (int i = 0; i < NPROC; i++) {
+      if (++p == &proc[NPROC]) p = proc;
+      if (p->state != RUNNABLE || !allowed(p, me)) continue;
+      if (throttled(p, now)) {
+        c->rtwake = sooner(c->rtwake, p->rtdeadline);
+        continue;
+      }
+      if (busy[p - proc] || kept(p, me) || holding(&p->lock)) continue;
+      if (best == 0 || before(p, best) || (!before(best, p) && p->cpu == me && best->cpu != me)) best = p;
+    }
+    if (best == 0) return 0;
+    if (tryacquire(&best->lock)) {
+      if (best->state == RUNNABLE) return best;
+      release(&best->lock);
+    }
+    busy[best - proc] = 1;
+  }
+}
+
+// Make p, locked and RUNNABLE, the one c is about to run.
+static void run(struct cpu *c, struct proc *p) {
+  if (cpus[p->cpu].wakee == p) cpus[p->cpu].wakee = 0;
+  p->cpu = c - cpus;
+  p->state = RUNNING;
+  c->proc = p;
+  p->tstamp = p->runstart = r_time();
+  groups[p->group].vtime = p->pass;
+  gvtime = groups[p->group].pass;
+  refill(p, p->runstart);
+  arm(c, p);
+  c->nswitch++;
+}
+
+// Having been switched to, release the lock of the process
+// this hart switched away from.
+static void switched(void) {
+  struct cpu *c = mycpu();
+  struct proc *prev = c->prev;
+
+  if (prev) {
+    c->prev = 0;
+    release(&prev->lock);
+  }
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
 //  - choose a process to run.
 //  - swtch to start running that process.
-//  - eventually that process transfers control
-//    via swtch back to the scheduler.
+//  - eventually that process, or another that sched()
+//    switched to from it, transfers control via swtch
+//    back to the scheduler, when there is nothing to run.
 void scheduler(void) {
-  struct proc *p;
+  struct proc *p, *last = &proc[NPROC - 1];
   struct cpu *c = mycpu();
 
   c->proc = 0;
+  __sync_fetch_and_or(&harts, 1UL << cpuid());
   for (;;) {
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    int found = 0;
-    for (p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if (p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-
-        found = 1;
-      }
-      release(&p->lock);
+    if ((p = pick(last)) != 0) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      run(c, p);
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now. sched() may have
+      // switched straight on to others; the last of them came
+      // back here still holding its lock.
+      c->proc = 0;
+      last = c->prev;
+      c->prev = 0;
+      release(&last->lock);
+      continue;
     }
-    if (found == 0) {
-      intr_on();
+
+    // wait for an interrupt. wakeup() sends an IPI to an idle
+    // hart; look once more with interrupts off, so one can't
+    // be taken between the look and the wfi and leave this
+    // hart asleep until the next tick. wfi returns on a
+    // pending interrupt even with interrupts off.
+    intr_off();
+    c->idle = 1;
+    __sync_synchronize();
+    for (p = proc; p < &proc[NPROC]; p++)
+      if (ready(p, cpuid(), r_time())) break;
+    if (p == &proc[NPROC]) {
+      // until a throttled process may run again, if any.
+      arm(c, 0);
+      uint64 t0 = r_time();
       asm volatile("wfi");
+      c->idletime += r_time() - t0;
     }
+    c->idle = 0;
   }
 }
 
-// Switch to scheduler.  Must hold only p->lock
+// Switch to the next process to run, or to the scheduler
+// if there is none.  Must hold only p->lock
 // and have changed proc->state. Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
@@ -458,15 +930,51 @@ void scheduler(void) {
 // there's no process.
 void sched(void) {
   int intena;
-  struct proc *p = myproc();
+  struct proc *p = myproc(), *q, *w;
+  struct cpu *c = mycpu();
 
   if (!holding(&p->lock)) panic("sched p->lock");
-  if (mycpu()->noff != 1) panic("sched locks");
+  if (c->noff != 1) panic("sched locks");
   if (p->state == RUNNING) panic("sched running");
   if (intr_get()) panic("sched interruptible");
 
-  intena = mycpu()->intena;
-  swtch(&p->context, &mycpu()->context);
+  account(p, 0);
+  charge(p);
+  intena = c->intena;
+
+  // switch straight to the next process, if there is one,
+  // rather than to scheduler() and from there to it. one
+  // that p just woke goes first if p is blocking, like a
+  // producer handing over to its consumer, unless there are
+  // real-time processes it might pass over.
+  q = 0;
+  if (rtutil == 0 && p->state != RUNNABLE && (w = c->wakee) != 0 && w != p && w->state == RUNNABLE &&
+      tryacquire(&w->lock)) {
+    if (w->state == RUNNABLE && allowed(w, cpuid()))
+      q = w;
+    else
+      release(&w->lock);
+  }
+  if (q == 0) q = pick(p);
+  if (ready(p, cpuid(), r_time()) && (q == 0 || !before(q, p))) {
+    // no one else should run yet.
+    if (q) release(&q->lock);
+    p->state = RUNNING;
+    arm(c, p);
+    return;
+  }
+  // a runnable p that may not run here, after setaffinity(),
+  // needs a hart that it may run on to notice it.
+  if (p->state == RUNNABLE && !allowed(p, cpuid())) ipi_kick(hartsfor(p));
+  c->prev = p;
+  if (q) {
+    run(c, q);
+    swtch(&p->context, &q->context);
+  } else {
+    swtch(&p->context, &c->context);
+  }
+
+  switched();
   mycpu()->intena = intena;
 }
 
@@ -475,6 +983,8 @@ void yield(void) {
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
+  p->readyat = r_time();
+  p->ru.nivcsw++;
   sched();
   release(&p->lock);
 }
@@ -484,7 +994,8 @@ void yield(void) {
 void forkret(void) {
   static int first = 1;
 
-  // Still holding p->lock from scheduler.
+  // Still holding p->lock from scheduler() or sched().
+  switched();
   release(&myproc()->lock);
 
   if (first) {
@@ -517,6 +1028,7 @@ void sleep(void *chan, struct spinlock *lk) {
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->ru.nvcsw++;
 
   sched();
 
@@ -530,6 +1042,57 @@ void sleep(void *chan, struct spinlock *lk) {
   }
 }
 
+// No hart p may run on is idle: make one that is running an
+// ordinary process switch at its next interrupt. This one
+// first, if p may run here.
+static void preempt(struct proc *p) {
+  struct proc *q;
+  int me = cpuid();
+
+  if (allowed(p, me) && ((q = mycpu()->proc) == 0 || !rt(q))) {
+    ipi_resched(me);
+    return;
+  }
+  for (int i = 0; i < NCPU; i++) {
+    if (((harts >> i) & 1) == 0 || !allowed(p, i)) continue;
+    if ((q = cpus[i].proc) == 0 || !rt(q)) {
+      ipi_resched(i);
+      return;
+    }
+  }
+}
+
+// Make p RUNNABLE, and place it. Caller holds p->lock.
+// If the hart p last ran on is idle, p goes back there.
+// Otherwise this hart keeps p for a while (MIGRATECOST):
+// when a producer wakes its consumer it soon blocks, and
+// sched() then hands over to p here, caches warm. Only
+// one process at a time is kept per hart, so that waking
+// many spreads them out.
+static void makeready(struct proc *p) {
+  struct cpu *c = mycpu();
+  int me = cpuid();
+
+  p->state = RUNNABLE;
+  p->readyat = r_time();
+
+  // no credit for time asleep.
+  struct group *g = &groups[p->group];
+  if (p->pass < g->vtime) p->pass = g->vtime;
+  if (g->pass < gvtime) g->pass = gvtime;
+
+  if (rt(p)) {
+    if (!ipi_kick(hartsfor(p))) preempt(p);
+    return;
+  }
+  if (p->cpu != me && allowed(p, p->cpu) && ipi_kick(1UL << p->cpu)) return;
+  if (allowed(p, me) && (c->wakee == 0 || c->wakee->state != RUNNABLE)) {
+    p->cpu = me;
+    c->wakee = p;
+  }
+  ipi_kick(hartsfor(p));
+}
+
 // Wake up all processes sleeping on chan.
 // Must be called without any p->lock.
 void wakeup(void *chan) {
@@ -537,20 +1100,24 @@ void wakeup(void *chan) {
 
   for (p = proc; p < &proc[NPROC]; p++) {
     acquire(&p->lock);
-    if (p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
-    }
+    if (p->state == SLEEPING && p->chan == chan) makeready(p);
     release(&p->lock);
   }
 }
 
+// Wake up p if it is sleeping on chan, without looking at
+// any other process.
+void wakeproc(struct proc *p, void *chan) {
+  acquire(&p->lock);
+  if (p->state == SLEEPING && p->chan == chan) makeready(p);
+  release(&p->lock);
+}
+
 // Wake up p if it is sleeping in wait(); used by exit().
 // Caller must hold p->lock.
 static void wakeup1(struct proc *p) {
   if (!holding(&p->lock)) panic("wakeup1");
-  if (p->chan == p && p->state == SLEEPING) {
-    p->state = RUNNABLE;
-  }
+  if (p->chan == p && p->state == SLEEPING) makeready(p);
 }
 
 // Kill the process with the given pid.
@@ -561,11 +1128,11 @@ int kill(int pid) {
 
   for (p = proc; p < &proc[NPROC]; p++) {
     acquire(&p->lock);
-    if (p->pid == pid) {
+    if (p->pid == pid && p->kfn == 0) {
       p->killed = 1;
       if (p->state == SLEEPING) {
         // Wake process from sleep().
-        p->state = RUNNABLE;
+        makeready(p);
       }
       release(&p->lock);
       return 0;
@@ -575,6 +1142,161 @@ int kill(int pid) {
   return -1;
 }
 
+// Return the process with the given pid, or the caller if
+// pid is 0, locked; or 0 if there is none.
+static struct proc *lockproc(int pid) {
+  struct proc *p, *me = myproc();
+
+  for (p = proc; p < &proc[NPROC]; p++) {
+    acquire(&p->lock);
+    if ((pid == 0 ? p == me : p->pid == pid) && p->state != UNUSED) return p;
+    release(&p->lock);
+  }
+  return 0;
+}
+
+// Pin the process with the given pid, or the caller if pid
+// is 0, to the harts in mask; ~0 unpins it.
+int setaffinity(int pid, uint64 mask) {
+  struct proc *p;
+
+  if (mask != ~0UL && (mask & harts) == 0) return -1;
+  if ((p = lockproc(pid)) == 0) return -1;
+  if (p->kfn) {
+    release(&p->lock);
+    return -1;
+  }
+  p->affinity = mask;
+  release(&p->lock);
+  // if the caller may no longer run here, move now; sched()
+  // kicks a hart it may run on.
+  if (p == myproc()) yield();
+  return 0;
+}
+
+// The harts the process with the given pid, or the caller
+// if pid is 0, may run on.
+int getaffinity(int pid, uint64 *mask) {
+  struct proc *p;
+
+  if ((p = lockproc(pid)) == 0) return -1;
+  *mask = hartsfor(p) & harts;
+  release(&p->lock);
+  return 0;
+}
+
+// Leave the harts in mask to pinned processes. At least one
+// hart must stay open to the rest.
+int isolate(uint64 mask) {
+  if ((harts & ~mask) == 0) return -1;
+  isolated = mask;
+  return 0;
+}
+
+// Give the process with the given pid, or the caller if pid
+// is 0, n tickets in its group.
+int settickets(int pid, int n) {
+  struct proc *p;
+
+  if (n < 1 || n > MAXTICKETS || (p = lockproc(pid)) == 0) return -1;
+  p->tickets = n;
+  release(&p->lock);
+  return 0;
+}
+
+// Move the process with the given pid, or the caller if pid
+// is 0, to group gid, or to a new group if gid is -1.
+// Returns the group.
+int setgroup(int pid, int gid) {
+  struct proc *p;
+
+  if (gid < -1 || gid >= NGROUP || (p = lockproc(pid)) == 0) return -1;
+  acquire(&group_lock);
+  if (gid == -1) {
+    for (gid = 1; gid < NGROUP && groups[gid].used; gid++)
+      ;
+    if (gid == NGROUP) goto bad;
+    memset(&groups[gid], 0, sizeof(groups[gid]));
+    groups[gid].used = 1;
+    groups[gid].tickets = DEFTICKETS;
+    groups[gid].pass = gvtime;
+  } else if (!groups[gid].used) {
+    goto bad;
+  }
+  // leave() would free the group if p were its only member.
+  if (gid != p->group) {
+    leave(p);
+    join(p, gid);
+  }
+  release(&group_lock);
+  release(&p->lock);
+  return gid;
+
+bad:
+  release(&group_lock);
+  release(&p->lock);
+  return -1;
+}
+
+// Give group gid n tickets against the other groups.
+int setshare(int gid, int n) {
+  int ret = -1;
+
+  if (gid < 0 || gid >= NGROUP || n < 1 || n > MAXTICKETS) return -1;
+  acquire(&group_lock);
+  if (groups[gid].used) {
+    groups[gid].tickets = n;
+    ret = 0;
+  }
+  release(&group_lock);
+  return ret;
+}
+
+// Make the process with the given pid, or the caller if pid
+// is 0, real-time: it may use budget microseconds of CPU time
+// every period. A period of 0 makes it ordinary again. Fails
+// if the real-time processes would need more than RTUTIL.
+int setrt(int pid, int period, int budget) {
+  struct proc *p;
+  uint u, old;
+
+  if (period < 0 || period > RTMAXPERIOD || budget < 0 || budget > period || (period > 0 && budget == 0)) return -1;
+  if ((p = lockproc(pid)) == 0) return -1;
+  // exit() has already given back a zombie's share.
+  if (p->kfn || p->state == ZOMBIE) goto bad;
+  u = utilof(period, budget);
+  old = utilof(p->rtperiod, p->rtbudget);
+  acquire(&rt_lock);
+  if (rtutil - old + u > RTUTIL) {
+    release(&rt_lock);
+    goto bad;
+  }
+  rtutil = rtutil - old + u;
+  release(&rt_lock);
+  p->rtperiod = (uint64)period * (TIMEFREQ / 1000000);
+  p->rtbudget = (uint64)budget * (TIMEFREQ / 1000000);
+  p->rtdeadline = p->rtleft = 0;
+  release(&p->lock);
+  return 0;
+
+bad:
+  release(&p->lock);
+  return -1;
+}
+
+// Called by devintr() on a software interrupt: should this
+// hart switch processes, for a real-time one?
+int rtcheck(void) {
+  struct cpu *c = mycpu();
+
+  if (c->resched || (c->rtat != 0 && r_time() >= c->rtat)) {
+    c->resched = 0;
+    c->rtat = 0;
+    return 1;
+  }
+  return 0;
+}
+
 // Copy to either a user address, or kernel address,
 // depending on usr_dst.
 // Returns 0 on success, -1 on error.
@@ -605,8 +1327,8 @@ int either_copyin(void *dst, int user_src, uint64 src, uint64 len) {
 // Runs when user types ^P on console.
 // No lock to avoid wedging a stuck machine further.
 void procdump(void) {
-  static char *states[] = {
-      [UNUSED] "unused", [SLEEPING] "sleep ", [RUNNABLE] "runble", [RUNNING] "run   ", [ZOMBIE] "zombie"};
+  static char *states[] = {[UNUSED] "unused",   [USED] "used  ",    [SLEEPING] "sleep ",
+                           [RUNNABLE] "runble", [RUNNING] "run   ", [ZOMBIE] "zombie"};
   struct proc *p;
   char *state;
 
@@ -617,7 +1339,47 @@ void procdump(void) {
       state = states[p->state];
     else
       state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
+    if (p->kfn)
+      printf("%d %s [%s] hart %d", p->pid, state, p->name, p->cpu);
+    else
+      printf("%d %s %s", p->pid, state, p->name);
     printf("\n");
   }
 }
+
+// Fill in st's process counts and per-CPU statistics.
+// The snapshot is taken without locks.
+void procstats(struct stats *st) {
+  struct proc *p;
+  struct cpu *c;
+  uint64 rss, ptpages;
+
+  for (p = proc; p < &proc[NPROC]; p++) {
+    if (p->state == UNUSED) continue;
+    st->nproc++;
+    if (p->pagetable) {
+      uvmusage(p->pagetable, &rss, &ptpages);
+      st->rsspages += rss;
+      st->ptpages += ptpages;
+    }
+    if (p->state == RUNNABLE) st->nrunnable++;
+    if (p->state == SLEEPING) st->nsleeping++;
+  }
+  acquire(&group_lock);
+  for (int i = 0; i < NGROUP; i++) {
+    if (!groups[i].used) continue;
+    st->group[i].tickets = groups[i].tickets;
+    st->group[i].nproc = groups[i].nproc;
+    st->group[i].runtime = groups[i].runtime;
+  }
+  release(&group_lock);
+  st->rtutil = rtutil;
+  for (c = cpus; c < &cpus[NCPU]; c++) {
+    struct cpustat *cs = &st->cpu[c - cpus];
+    cs->pid = (p = c->proc) ? p->pid : 0;
+    cs->nswitch = c->nswitch;
+    cs->nwork = workdone(c - cpus);
+    cs->nsoftirq = c->nsoftirq;
+    cs->idle = c->idletime;
+  }
+}
@@ -1,3 +1,5 @@
+#include "rusage.h"
+
 // Saved registers for kernel context switches.
 struct context {
   uint64 ra;
@@ -18,13 +20,25 @@ struct context {
   uint64 s11;
 };
 
-// Per-CPU state.
+// Per-CPU state, a cache line or more each, so that one
+// hart's writes don't take lines the others are using.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
-};
+  int idle;                   // In wfi, waiting for a RUNNABLE process.
+  struct proc *prev;          // Switched away from; its lock is still held.
+  struct proc *wakee;         // Woken here and kept for this hart; see makeready().
+  uint nswitch;               // Switches to a process.
+  uint64 idletime;            // r_time() ticks spent in wfi.
+  int resched;                // Preempt the running process; see makeready().
+  uint64 rtat;                // r_time() of the next budget or period event, or 0.
+  uint64 rtwake;              // Earliest period end of a throttled process, or 0.
+  uint softpending;           // Raised softirqs, 1 << SOFTIRQ_; see softirq.c.
+  int insoftirq;              // Running them.
+  uint nsoftirq;              // Times it has.
+} __attribute__((aligned(CACHELINE)));
 
 extern struct cpu cpus[NCPU];
 
@@ -78,24 +92,40 @@ struct trapframe {
   /* 264 */ uint64 t4;
   /* 272 */ uint64 t5;
   /* 280 */ uint64 t6;
+  /* 288 */ uint64 kernel_syscall; // usersyscall()
 };
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
+// Per-process state, laid out by who touches it: the lock,
+// written by every acquire; then what other harts' schedulers
+// and wakeups read; then the private fields, written all the
+// time by the hart running the process. each part starts a
+// cache line.
 struct proc {
   struct spinlock lock;
 
   // p->lock must be held when using these:
-  enum procstate state;        // Process state
-  struct proc *parent;         // Parent process
+  enum procstate state __attribute__((aligned(CACHELINE))); // Process state
   void *chan;                  // If non-zero, sleeping on chan
+  int pid;                     // Process ID
   int killed;                  // If non-zero, have been killed
+  int cpu;                     // Hart it last ran on, or was woken onto
+  uint64 affinity;             // Harts it may run on; ~0 unless pinned
+  int group;                   // Scheduling group; see proc.c
+  int tickets;                 // Share of its group's CPU time
+  uint64 pass;                 // Stride pass: CPU time used / tickets
+  uint64 runstart;             // r_time() when last switched to
+  uint64 readyat;              // r_time() when it last became RUNNABLE
+  uint64 rtperiod;             // Real-time period in time CSR ticks, or 0; see setrt()
+  uint64 rtbudget;             // CPU time it may use each period
+  uint64 rtdeadline;           // End of its current period
+  uint64 rtleft;               // Budget left in the current period
+  struct proc *parent;         // Parent process
   int xstate;                  // Exit status to be returned to parent's wait
-  int pid;                     // Process ID
 
   // these are private to the process, so p->lock need not be held.
-  uint64 kstack;               // Virtual address of kernel stack
+  uint64 kstack __attribute__((aligned(CACHELINE))); // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
@@ -103,4 +133,10 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
-};
+  uint64 tstamp;               // r_time() when utime or stime was last charged
+  struct rusage ru;            // resources used so far
+  struct rusage cru;           // by reaped children; changed only by wait()
+  struct rlimit rlimit;        // RLIMIT_RSS, inherited from the parent
+  void (*kfn)(void *);         // kernel thread body, or 0 for a user process
+  void *karg;                  // argument for kfn
+} __attribute__((aligned(CACHELINE)));
@@ -0,0 +1,28 @@
+#define RUSAGE_SELF 0       // the calling process
+#define RUSAGE_CHILDREN -1  // its children that wait() has reaped, and theirs
+
+#define TIMEFREQ 10000000  // time CSR ticks per second in qemu
+
+// Resources used by a process. Times are in time CSR ticks.
+struct rusage {
+  uint64 utime;   // running in user space
+  uint64 stime;   // running in the kernel on its behalf
+  uint nvcsw;     // gave up the CPU to wait
+  uint nivcsw;    // preempted at a timer interrupt
+  uint nfault;    // page faults
+  uint inblock;   // blocks read from the disk
+  uint oublock;   // blocks written to the disk
+  uint nsyscall;  // system calls made
+  uint maxrss;    // most pages held at once; see RLIMIT_RSS
+};
+
+#define RLIMIT_RSS 0  // bytes of user pages, trapframe and page tables held
+
+#define RLIM_INFINITY (~0UL)
+
+// A resource limit. cur is enforced; a process may lower max,
+// and set cur anywhere up to it.
+struct rlimit {
+  uint64 cur;
+  uint64 max;
+};
@@ -0,0 +1,7 @@
+// Something holding memory it can give back to kalloc().
+struct shrinker {
+  char *name;
+  int (*scan)(int);        // free up to n pages; returns pages freed
+  uint64 freed;            // pages freed so far
+  struct shrinker *next;   // on the kalloc() shrinker list
+};
@@ -0,0 +1,47 @@
+//
+// bottom halves for device interrupts.
+//
+// a device's interrupt handler, the top half, only quiets
+// the device and raises a softirq on its hart. the trap
+// handler runs the raised softirqs on the same hart just
+// before it returns, with interrupts on, so other devices
+// and the timer aren't held up; one run handles all that
+// arrived since the last. a softirq handler may not sleep.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "softirq.h"
+#include "defs.h"
+
+static void (*handlers[NSOFTIRQ])(void) = {
+    [SOFTIRQ_DISK] virtio_disk_bh,
+    [SOFTIRQ_UART] uartbh,
+};
+
+// ask for softirq n to run on this hart.
+// interrupts must be disabled.
+void raise_softirq(int n) { mycpu()->softpending |= 1 << n; }
+
+// run this hart's raised softirqs, unless a trap taken while
+// running them has got here again. called by the trap
+// handlers with interrupts off, and returns with them off.
+void softirq(void) {
+  struct cpu *c = mycpu();
+  uint bits;
+
+  if (c->insoftirq) return;
+  c->insoftirq = 1;
+  while ((bits = c->softpending) != 0) {
+    c->softpending = 0;
+    c->nsoftirq++;
+    intr_on();
+    for (int n = 0; n < NSOFTIRQ; n++)
+      if (bits & (1 << n)) handlers[n]();
+    intr_off();
+  }
+  c->insoftirq = 0;
+}
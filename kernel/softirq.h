@@ -0,0 +1,4 @@
+// Bottom halves, raised by device interrupt handlers; see softirq.c.
+#define SOFTIRQ_DISK 0  // virtio disk completions
+#define SOFTIRQ_UART 1  // uart input and output
+#define NSOFTIRQ 2
@@ -0,0 +1,16 @@
+// File actions for spawn(), applied in order to the child's
+// file table before it starts running the new program.
+// Both the kernel and user programs use this header file.
+
+#define SPAWN_CLOSE 1  // close fd
+#define SPAWN_DUP   2  // fd becomes a copy of descriptor arg
+#define SPAWN_OPEN  3  // fd becomes open(path, arg)
+
+#define MAXSPAWNACT 16  // max file actions per spawn
+
+struct spawnact {
+  int op;      // SPAWN_*
+  int fd;      // descriptor in the child to set up
+  int arg;     // SPAWN_DUP: source descriptor; SPAWN_OPEN: open mode
+  char *path;  // SPAWN_OPEN
+};
@@ -37,6 +37,21 @@ void acquire(struct spinlock *lk) {
   lk->cpu = mycpu();
 }
 
+// Acquire the lock if no one holds it, without spinning.
+// Returns 1 if it did, 0 if not.
+int tryacquire(struct spinlock *lk) {
+  push_off();
+  if (holding(lk)) panic("tryacquire");
+
+  if (__sync_lock_test_and_set(&lk->locked, 1) != 0) {
+    pop_off();
+    return 0;
+  }
+  __sync_synchronize();
+  lk->cpu = mycpu();
+  return 1;
+}
+
 // Release the lock.
 void release(struct spinlock *lk) {
   if (!holding(lk)) panic("release");
@@ -10,8 +10,8 @@ void timerinit();
 // entry.S needs one stack per CPU.
 __attribute__((aligned(16))) char stack0[4096 * NCPU];
 
-// scratch area for timer interrupt, one per CPU.
-uint64 mscratch0[NCPU * 32];
+// scratch area for timer and IPI interrupts, one per CPU.
+uint64 mscratch0[NCPU * 32] __attribute__((aligned(CACHELINE)));
 
 // assembly code in kernelvec.S for machine-mode timer interrupt.
 extern void timervec();
@@ -41,6 +41,9 @@ void start() {
   w_pmpaddr0(0x1fffffffffffffull);
   w_pmpcfg0(0x1f);
 
+  // allow supervisor mode to read the time CSR.
+  w_mcounteren(r_mcounteren() | 2);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -49,9 +52,8 @@ void start() {
   w_tp(id);
 
   if (cpuid() == 0) {
-    // init uart and printf
+    // init uart, which printf writes to
     consoleinit();
-    printfinit();
     printf("[210810302] in start, init driver, interrupts and change mode\n");
   }
 
@@ -75,9 +77,16 @@ void timerinit() {
   // scratch[0..3] : space for timervec to save registers.
   // scratch[4] : address of CLINT MTIMECMP register.
   // scratch[5] : desired interval (in cycles) between timer interrupts.
+  // scratch[6] : address of CLINT MSIP register, to acknowledge IPIs.
+  // scratch[7] : set by timervec when the timer fires; see devintr().
+  // scratch[8] : time of the next regular tick.
+  // scratch[9] : time of an extra interrupt; see clockat().
   uint64 *scratch = &mscratch0[32 * id];
   scratch[4] = CLINT_MTIMECMP(id);
   scratch[5] = interval;
+  scratch[6] = CLINT_MSIP(id);
+  scratch[8] = *(uint64 *)CLINT_MTIMECMP(id);
+  scratch[9] = 0;
   w_mscratch((uint64)scratch);
 
   // set the machine-mode trap handler.
@@ -86,6 +95,6 @@ void timerinit() {
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer and software (IPI) interrupts.
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
 }
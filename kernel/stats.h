@@ -0,0 +1,38 @@
+// System statistics, as copied out by stats().
+// Counters count from boot; callers take differences.
+
+struct cpustat {
+  int pid;        // process running, or 0
+  uint nswitch;   // switches from the scheduler to a process
+  uint nintr;     // device interrupts claimed
+  uint nwork;     // work its kworker has run
+  uint nsoftirq;  // bottom-half runs, each for one or more interrupts
+  uint64 idle;    // time CSR ticks spent in wfi
+};
+
+struct groupstat {
+  uint tickets;   // share of the CPU; 0 if the group is not in use
+  uint nproc;     // processes in it
+  uint64 runtime; // time CSR ticks they have run
+};
+
+struct stats {
+  uint64 time;     // time CSR when the snapshot was taken
+  uint ticks;      // clock ticks since boot
+  uint freepages;  // free physical pages
+  uint freeblocks[KMAXORDER + 1];  // of which in free blocks of 2^i pages
+  uint nproc;      // processes in use
+  uint nrunnable;  // of which RUNNABLE
+  uint nsleeping;  // of which SLEEPING
+  uint rtutil;     // per mille of a hart admitted to real-time processes
+  uint rsspages;   // user pages mapped by them, trapframes included
+  uint ptpages;    // and their page-table pages
+  uint bhit;       // buffer cache lookups that found the block
+  uint bmiss;      // and that had to read or recycle one
+  uint iused;      // in-memory inodes in use, of NINODE
+  uint ncommit;    // log commits
+  uint nread;      // disk reads
+  uint nwrite;     // disk writes
+  struct cpustat cpu[NCPU];
+  struct groupstat group[NGROUP];
+};
@@ -88,6 +88,21 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_spawn(void);
+extern uint64 sys_irqaffinity(void);
+extern uint64 sys_irqstat(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_stats(void);
+extern uint64 sys_dmesg(void);
+extern uint64 sys_getrlimit(void);
+extern uint64 sys_setrlimit(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_sched_isolate(void);
+extern uint64 sys_sched_settickets(void);
+extern uint64 sys_sched_setgroup(void);
+extern uint64 sys_sched_setshare(void);
+extern uint64 sys_sched_setrt(void);
 
 static uint64 (*syscalls[])(void) = {
     [SYS_fork] sys_fork,   [SYS_exit] sys_exit,     [SYS_wait] sys_wait,     [SYS_pipe] sys_pipe,
@@ -95,7 +110,14 @@ static uint64 (*syscalls[])(void) = {
     [SYS_chdir] sys_chdir, [SYS_dup] sys_dup,       [SYS_getpid] sys_getpid, [SYS_sbrk] sys_sbrk,
     [SYS_sleep] sys_sleep, [SYS_uptime] sys_uptime, [SYS_open] sys_open,     [SYS_write] sys_write,
     [SYS_mknod] sys_mknod, [SYS_unlink] sys_unlink, [SYS_link] sys_link,     [SYS_mkdir] sys_mkdir,
-    [SYS_close] sys_close,
+    [SYS_close] sys_close, [SYS_spawn] sys_spawn,   [SYS_irqaffinity] sys_irqaffinity, [SYS_irqstat] sys_irqstat,
+    [SYS_getrusage] sys_getrusage, [SYS_stats] sys_stats,
+    [SYS_dmesg] sys_dmesg,
+    [SYS_getrlimit] sys_getrlimit, [SYS_setrlimit] sys_setrlimit,
+    [SYS_sched_setaffinity] sys_sched_setaffinity, [SYS_sched_getaffinity] sys_sched_getaffinity,
+    [SYS_sched_isolate] sys_sched_isolate, [SYS_sched_settickets] sys_sched_settickets,
+    [SYS_sched_setgroup] sys_sched_setgroup, [SYS_sched_setshare] sys_sched_setshare,
+    [SYS_sched_setrt] sys_sched_setrt,
 };
 
 void syscall(void) {
@@ -103,6 +125,7 @@ void syscall(void) {
   struct proc *p = myproc();
 
   num = p->trapframe->a7;
+  p->ru.nsyscall++;
   if (num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     p->trapframe->a0 = syscalls[num]();
   } else {
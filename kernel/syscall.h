@@ -20,3 +20,18 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_spawn  22
+#define SYS_irqaffinity 23
+#define SYS_irqstat 24
+#define SYS_getrusage 25
+#define SYS_stats  26
+#define SYS_dmesg  27
+#define SYS_getrlimit 28
+#define SYS_setrlimit 29
+#define SYS_sched_setaffinity 30
+#define SYS_sched_getaffinity 31
+#define SYS_sched_isolate 32
+#define SYS_sched_settickets 33
+#define SYS_sched_setgroup 34
+#define SYS_sched_setshare 35
+#define SYS_sched_setrt 36
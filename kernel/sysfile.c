@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "spawn.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -237,14 +238,12 @@ static struct inode *create(char *path, short type, short major, short minor) {
   return ip;
 }
 
-uint64 sys_open(void) {
-  char path[MAXPATH];
-  int fd, omode;
+// Open path with mode omode and return a new struct file
+// holding the only reference, or 0 on failure.
+// Used by open() and by spawn()'s SPAWN_OPEN action.
+struct file *fileopen(char *path, int omode) {
   struct file *f;
   struct inode *ip;
-  int n;
-
-  if ((n = argstr(0, path, MAXPATH)) < 0 || argint(1, &omode) < 0) return -1;
 
   begin_op();
 
@@ -252,32 +251,31 @@ uint64 sys_open(void) {
     ip = create(path, T_FILE, 0, 0);
     if (ip == 0) {
       end_op();
-      return -1;
+      return 0;
     }
   } else {
     if ((ip = namei(path)) == 0) {
       end_op();
-      return -1;
+      return 0;
     }
     ilock(ip);
     if (ip->type == T_DIR && omode != O_RDONLY) {
       iunlockput(ip);
       end_op();
-      return -1;
+      return 0;
     }
   }
 
   if (ip->type == T_DEVICE && (ip->major < 0 || ip->major >= NDEV)) {
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
-  if ((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0) {
-    if (f) fileclose(f);
+  if ((f = filealloc()) == 0) {
     iunlockput(ip);
     end_op();
-    return -1;
+    return 0;
   }
 
   if (ip->type == T_DEVICE) {
@@ -298,6 +296,21 @@ uint64 sys_open(void) {
   iunlock(ip);
   end_op();
 
+  return f;
+}
+
+uint64 sys_open(void) {
+  char path[MAXPATH];
+  int fd, omode;
+  struct file *f;
+
+  if (argstr(0, path, MAXPATH) < 0 || argint(1, &omode) < 0) return -1;
+
+  if ((f = fileopen(path, omode)) == 0) return -1;
+  if ((fd = fdalloc(f)) < 0) {
+    fileclose(f);
+    return -1;
+  }
   return fd;
 }
 
@@ -354,40 +367,84 @@ uint64 sys_chdir(void) {
   return 0;
 }
 
-uint64 sys_exec(void) {
-  char path[MAXPATH], *argv[MAXARG];
-  int i;
-  uint64 uargv, uarg;
-
-  if (argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0) {
-    return -1;
-  }
-  memset(argv, 0, sizeof(argv));
-  for (i = 0;; i++) {
-    if (i >= NELEM(argv)) {
-      goto bad;
-    }
-    if (fetchaddr(uargv + sizeof(uint64) * i, (uint64 *)&uarg) < 0) {
-      goto bad;
-    }
+// Fetch the user argv array at uargv into argv[MAXARG],
+// 0-terminated, with the strings packed into one kalloc()ed
+// page. exec() pushes them all onto a one-page stack, so
+// they could never have used more. Returns the page, for
+// the caller to kfree(), or 0 on failure.
+static char *fetchargv(uint64 uargv, char **argv) {
+  int i, n, off;
+  uint64 uarg;
+  char *page;
+
+  if ((page = kalloc()) == 0) return 0;
+  for (i = 0, off = 0;; i++) {
+    if (i >= MAXARG) goto bad;
+    if (fetchaddr(uargv + sizeof(uint64) * i, (uint64 *)&uarg) < 0) goto bad;
     if (uarg == 0) {
       argv[i] = 0;
       break;
     }
-    argv[i] = kalloc();
-    if (argv[i] == 0) goto bad;
-    if (fetchstr(uarg, argv[i], PGSIZE) < 0) goto bad;
+    argv[i] = page + off;
+    if ((n = fetchstr(uarg, argv[i], PGSIZE - off)) < 0) goto bad;
+    off += n + 1;
+  }
+  return page;
+
+bad:
+  kfree(page);
+  return 0;
+}
+
+uint64 sys_exec(void) {
+  char path[MAXPATH], *argv[MAXARG], *args;
+  uint64 uargv;
+
+  if (argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0) {
+    return -1;
   }
+  if ((args = fetchargv(uargv, argv)) == 0) return -1;
 
   int ret = exec(path, argv);
 
-  for (i = 0; i < NELEM(argv) && argv[i] != 0; i++) kfree(argv[i]);
+  kfree(args);
 
   return ret;
+}
 
-bad:
-  for (i = 0; i < NELEM(argv) && argv[i] != 0; i++) kfree(argv[i]);
-  return -1;
+// spawn(path, argv, act, nact): start path in a new child
+// after applying the file actions act[0..nact) to a copy
+// of the caller's file table. Returns the child's pid.
+uint64 sys_spawn(void) {
+  char path[MAXPATH], *argv[MAXARG], *page, *args;
+  struct spawnact *act;
+  uint64 uargv, uact;
+  int i, nact, pid = -1;
+
+  if (argstr(0, path, MAXPATH) < 0 || argaddr(1, &uargv) < 0 || argaddr(2, &uact) < 0 || argint(3, &nact) < 0) {
+    return -1;
+  }
+  if (nact < 0 || nact > MAXSPAWNACT) return -1;
+
+  // the actions, then their paths, share one page
+  // rather than take up the kernel stack.
+  if ((page = kalloc()) == 0) return -1;
+  act = (struct spawnact *)page;
+  if (copyin(myproc()->pagetable, (char *)act, uact, nact * sizeof(*act)) < 0) goto out;
+  for (i = 0; i < nact; i++) {
+    if (act[i].op != SPAWN_OPEN) continue;
+    char *kpath = page + MAXSPAWNACT * sizeof(*act) + i * MAXPATH;
+    if (fetchstr((uint64)act[i].path, kpath, MAXPATH) < 0) goto out;
+    act[i].path = kpath;
+  }
+
+  if ((args = fetchargv(uargv, argv)) == 0) goto out;
+  pid = spawn(path, argv, act, nact);
+  kfree(args);
+
+out:
+  kfree(page);
+  return pid;
 }
 
 uint64 sys_pipe(void) {
@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "stats.h"
 
 uint64 sys_exit(void) {
   int n;
@@ -36,20 +37,10 @@ uint64 sys_sbrk(void) {
 
 uint64 sys_sleep(void) {
   int n;
-  uint ticks0;
 
   if (argint(0, &n) < 0) return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while (ticks - ticks0 < n) {
-    if (myproc()->killed) {
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
-  return 0;
+  if (n <= 0) return 0;
+  return timer_sleep(ticks + n);
 }
 
 uint64 sys_kill(void) {
@@ -69,3 +60,158 @@ uint64 sys_uptime(void) {
   release(&tickslock);
   return xticks;
 }
+
+// deliver device interrupt irq only to the harts in mask,
+// or if mask is 0, as by default.
+uint64 sys_irqaffinity(void) {
+  int irq, mask;
+
+  if (argint(0, &irq) < 0 || argint(1, &mask) < 0) return -1;
+  return plic_setaffinity(irq, mask);
+}
+
+// copy out how many times each hart has claimed irq.
+uint64 sys_irqstat(void) {
+  int irq;
+  uint64 addr;
+  uint counts[NCPU];
+
+  if (argint(0, &irq) < 0 || argaddr(1, &addr) < 0) return -1;
+  if (irq < 0 || irq >= NIRQ) return -1;
+  plic_counts(irq, counts);
+  if (copyout(myproc()->pagetable, addr, (char *)counts, sizeof(counts)) < 0) return -1;
+  return 0;
+}
+
+// copy out the resources used by this process
+// (RUSAGE_SELF) or its reaped children (RUSAGE_CHILDREN).
+uint64 sys_getrusage(void) {
+  int who;
+  uint64 addr;
+  struct proc *p = myproc();
+  struct rusage *ru;
+
+  if (argint(0, &who) < 0 || argaddr(1, &addr) < 0) return -1;
+  if (who == RUSAGE_SELF) {
+    account(p, 0);
+    ru = &p->ru;
+  } else if (who == RUSAGE_CHILDREN) {
+    ru = &p->cru;
+  } else {
+    return -1;
+  }
+  if (copyout(p->pagetable, addr, (char *)ru, sizeof(*ru)) < 0) return -1;
+  return 0;
+}
+
+uint64 sys_getrlimit(void) {
+  int resource;
+  uint64 addr;
+  struct proc *p = myproc();
+
+  if (argint(0, &resource) < 0 || argaddr(1, &addr) < 0) return -1;
+  if (resource != RLIMIT_RSS) return -1;
+  if (copyout(p->pagetable, addr, (char *)&p->rlimit, sizeof(p->rlimit)) < 0) return -1;
+  return 0;
+}
+
+uint64 sys_setrlimit(void) {
+  int resource;
+  uint64 addr;
+  struct rlimit rl;
+  struct proc *p = myproc();
+
+  if (argint(0, &resource) < 0 || argaddr(1, &addr) < 0) return -1;
+  if (resource != RLIMIT_RSS) return -1;
+  if (copyin(p->pagetable, (char *)&rl, addr, sizeof(rl)) < 0) return -1;
+  if (rl.cur > rl.max || rl.max > p->rlimit.max) return -1;
+  p->rlimit = rl;
+  return 0;
+}
+
+uint64 sys_sched_setaffinity(void) {
+  int pid;
+  uint64 mask;
+
+  if (argint(0, &pid) < 0 || argaddr(1, &mask) < 0) return -1;
+  return setaffinity(pid, mask);
+}
+
+uint64 sys_sched_getaffinity(void) {
+  int pid;
+  uint64 addr, mask;
+
+  if (argint(0, &pid) < 0 || argaddr(1, &addr) < 0) return -1;
+  if (getaffinity(pid, &mask) < 0) return -1;
+  if (copyout(myproc()->pagetable, addr, (char *)&mask, sizeof(mask)) < 0) return -1;
+  return 0;
+}
+
+uint64 sys_sched_isolate(void) {
+  uint64 mask;
+
+  if (argaddr(0, &mask) < 0) return -1;
+  return isolate(mask);
+}
+
+uint64 sys_sched_settickets(void) {
+  int pid, n;
+
+  if (argint(0, &pid) < 0 || argint(1, &n) < 0) return -1;
+  return settickets(pid, n);
+}
+
+uint64 sys_sched_setgroup(void) {
+  int pid, gid;
+
+  if (argint(0, &pid) < 0 || argint(1, &gid) < 0) return -1;
+  return setgroup(pid, gid);
+}
+
+uint64 sys_sched_setshare(void) {
+  int gid, n;
+
+  if (argint(0, &gid) < 0 || argint(1, &n) < 0) return -1;
+  return setshare(gid, n);
+}
+
+uint64 sys_sched_setrt(void) {
+  int pid, period, budget;
+
+  if (argint(0, &pid) < 0 || argint(1, &period) < 0 || argint(2, &budget) < 0) return -1;
+  return setrt(pid, period, budget);
+}
+
+// copy out a snapshot of system statistics.
+uint64 sys_stats(void) {
+  uint64 addr;
+  struct stats st;
+  uint counts[NCPU];
+
+  if (argaddr(0, &addr) < 0) return -1;
+  memset(&st, 0, sizeof(st));
+  st.time = r_time();
+  st.ticks = ticks;
+  st.freepages = kfreepages();
+  kfreeblocks(st.freeblocks);
+  bstats(&st.bhit, &st.bmiss);
+  st.iused = iused();
+  st.ncommit = logcommits();
+  diskstats(&st.nread, &st.nwrite);
+  procstats(&st);
+  for (int irq = 1; irq < NIRQ; irq++) {
+    plic_counts(irq, counts);
+    for (int i = 0; i < NCPU; i++) st.cpu[i].nintr += counts[i];
+  }
+  if (copyout(myproc()->pagetable, addr, (char *)&st, sizeof(st)) < 0) return -1;
+  return 0;
+}
+
+// copy the latest kernel messages, up to n bytes of them.
+uint64 sys_dmesg(void) {
+  uint64 addr;
+  int n;
+
+  if (argaddr(0, &addr) < 0 || argint(1, &n) < 0) return -1;
+  return klogread(addr, n);
+}
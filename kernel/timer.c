@@ -0,0 +1,121 @@
+//
+// per-CPU timer wheels.
+//
+// a timer goes on the wheel of the hart that adds it, in the
+// slot for its expiry tick, and that hart's timer interrupt
+// runs it once ticks gets there. so sleep() only wakes the
+// sleeper when its time is up, and only the hart it went to
+// sleep on does any work for it.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "defs.h"
+
+#define NSLOT 64  // slots per wheel; later timers wait a lap
+
+struct wheel {
+  struct spinlock lock;
+  uint now;  // ticks value this wheel has run timers up to
+  struct timer *slot[NSLOT];
+} __attribute__((aligned(CACHELINE))) wheels[NCPU];
+
+void wheelinit(void) {
+  for (int i = 0; i < NCPU; i++) initlock(&wheels[i].lock, "wheel");
+}
+
+// caller holds w->lock.
+static void insert(struct wheel *w, struct timer *t, uint expires) {
+  // one that is already due runs at the next tick.
+  if ((int)(expires - w->now) <= 0) expires = w->now + 1;
+  t->expires = expires;
+  t->wheel = w;
+  t->next = w->slot[expires % NSLOT];
+  w->slot[expires % NSLOT] = t;
+}
+
+// caller holds w->lock.
+static void unlink(struct wheel *w, struct timer *t) {
+  struct timer **pp;
+
+  for (pp = &w->slot[t->expires % NSLOT]; *pp != t; pp = &(*pp)->next)
+    ;
+  *pp = t->next;
+  t->wheel = 0;
+}
+
+// return this hart's wheel, locked.
+static struct wheel *lockwheel(void) {
+  struct wheel *w;
+
+  push_off();
+  w = &wheels[cpuid()];
+  acquire(&w->lock);
+  pop_off();
+  return w;
+}
+
+// run t->fn(t) at tick expires, on this hart.
+void timer_add(struct timer *t, uint expires) {
+  struct wheel *w = lockwheel();
+
+  insert(w, t, expires);
+  release(&w->lock);
+}
+
+// take t off its wheel. returns 0 if it had already run.
+int timer_del(struct timer *t) {
+  struct wheel *w = t->wheel;
+
+  if (w == 0) return 0;
+  acquire(&w->lock);
+  if (t->wheel != w) {
+    release(&w->lock);
+    return 0;
+  }
+  unlink(w, t);
+  release(&w->lock);
+  return 1;
+}
+
+// called on each hart's timer interrupt: run this hart's
+// timers that are due.
+void timertick(void) {
+  struct wheel *w = &wheels[cpuid()];
+  struct timer *t, *next;
+
+  uint now = ticks;
+
+  acquire(&w->lock);
+  while (w->now != now) {
+    w->now++;
+    for (t = w->slot[w->now % NSLOT]; t; t = next) {
+      next = t->next;
+      if (t->expires == w->now) {
+        unlink(w, t);
+        t->fn(t);
+      }
+    }
+  }
+  release(&w->lock);
+}
+
+static void wake(struct timer *t) { wakeproc(t->arg, t); }
+
+// sleep until ticks reaches expires. returns -1 if the
+// process was killed first.
+int timer_sleep(uint expires) {
+  struct proc *p = myproc();
+  struct timer t = {.fn = wake, .arg = p};
+  struct wheel *w = lockwheel();
+
+  insert(w, &t, expires);
+  while (t.wheel && !p->killed) sleep(&t, &w->lock);
+  if (t.wheel) unlink(w, &t);
+  release(&w->lock);
+  return p->killed ? -1 : 0;
+}
@@ -0,0 +1,8 @@
+// Timer on a per-CPU timer wheel.
+struct timer {
+  uint expires;                // ticks value at which fn runs
+  void (*fn)(struct timer *);  // run by the timer interrupt, wheel locked
+  void *arg;                   // for fn
+  struct timer *next;          // in the wheel slot
+  struct wheel *wheel;         // wheel it is on, or 0 once it has run
+};
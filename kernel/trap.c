@@ -6,7 +6,7 @@
 #include "proc.h"
 #include "defs.h"
 
-struct spinlock tickslock;
+struct spinlock tickslock __attribute__((aligned(CACHELINE)));
 uint ticks;
 
 extern char trampoline[], uservec[], userret[];
@@ -15,11 +15,18 @@ extern char trampoline[], uservec[], userret[];
 void kernelvec();
 
 extern int devintr();
+uint64 usersyscall(void);
+extern uint64 mscratch0[];
 
 void trapinit(void) { initlock(&tickslock, "time"); }
 
 // set up to take exceptions and traps while in the kernel.
-void trapinithart(void) { w_stvec((uint64)kernelvec); }
+void trapinithart(void) {
+  w_stvec((uint64)kernelvec);
+
+  // let user programs read the time CSR, for benchmarks.
+  w_scounteren(2);
+}
 
 //
 // handle an interrupt, exception, or system call from user space.
@@ -35,6 +42,7 @@ void usertrap(void) {
   w_stvec((uint64)kernelvec);
 
   struct proc *p = myproc();
+  account(p, 1);
 
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -53,14 +61,22 @@ void usertrap(void) {
     intr_on();
 
     syscall();
+  } else if ((r_scause() == 12 || r_scause() == 13 || r_scause() == 15) &&
+             uvmfault(p, r_stval(), r_scause() != 13) == 0) {
+    // a page of user memory touched for the first time.
+    p->ru.nfault++;
   } else if ((which_dev = devintr()) != 0) {
     // ok
   } else {
+    if (r_scause() == 12 || r_scause() == 13 || r_scause() == 15) p->ru.nfault++;
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
     p->killed = 1;
   }
 
+  // the bottom halves of device interrupts.
+  if (which_dev != 0) softirq();
+
   if (p->killed) exit(-1);
 
   // give up the CPU if this is a timer interrupt.
@@ -69,17 +85,18 @@ void usertrap(void) {
   usertrapret();
 }
 
-//
-// return to user space
-//
-void usertrapret(void) {
-  struct proc *p = myproc();
-
+// set up to return to user space: traps to uservec, the
+// trapframe fields it needs, sstatus and sepc. returns the
+// user satp.
+static uint64 prepret(struct proc *p) {
   // we're about to switch the destination of traps from
   // kerneltrap() to usertrap(), so turn off interrupts until
   // we're back in user space, where usertrap() is correct.
   intr_off();
 
+  // from here on, p's time is user time.
+  account(p, 0);
+
   // send syscalls, interrupts, and exceptions to trampoline.S
   w_stvec(TRAMPOLINE + (uservec - trampoline));
 
@@ -88,6 +105,7 @@ void usertrapret(void) {
   p->trapframe->kernel_satp = r_satp();          // kernel page table
   p->trapframe->kernel_sp = p->kstack + PGSIZE;  // process's kernel stack
   p->trapframe->kernel_trap = (uint64)usertrap;
+  p->trapframe->kernel_syscall = (uint64)usersyscall;
   p->trapframe->kernel_hartid = r_tp();  // hartid for cpuid()
 
   // set up the registers that trampoline.S's sret will use
@@ -103,7 +121,14 @@ void usertrapret(void) {
   w_sepc(p->trapframe->epc);
 
   // tell trampoline.S the user page table to switch to.
-  uint64 satp = MAKE_SATP(p->pagetable);
+  return MAKE_SATP(p->pagetable);
+}
+
+//
+// return to user space
+//
+void usertrapret(void) {
+  uint64 satp = prepret(myproc());
 
   // jump to trampoline.S at the top of memory, which
   // switches to the user page table, restores user registers,
@@ -112,6 +137,35 @@ void usertrapret(void) {
   ((void (*)(uint64, uint64))fn)(TRAPFRAME, satp);
 }
 
+//
+// handle a system call from user space, on the fast path from
+// trampoline.S. uservec has saved only ra, sp, gp, tp and the
+// argument registers, and returns to user space itself when
+// this returns the user satp; the C calling convention keeps
+// the s registers. fork() goes through usertrap(), since its
+// child starts from a copy of the whole trapframe.
+//
+uint64 usersyscall(void) {
+  struct proc *p = myproc();
+
+  account(p, 1);
+  w_stvec((uint64)kernelvec);
+
+  // return to the instruction after the ecall.
+  p->trapframe->epc = r_sepc() + 4;
+
+  if (p->killed) exit(-1);
+  intr_on();
+  syscall();
+  if (p->killed) exit(-1);
+
+  uint64 satp = prepret(p);
+  // while p slept, other processes' traps on this hart (or on
+  // the one p left) put their own a0 in sscratch.
+  w_sscratch(TRAPFRAME);
+  return satp;
+}
+
 // interrupts and exceptions from kernel code go here via kernelvec,
 // on whatever the current kernel stack is.
 void kerneltrap() {
@@ -129,8 +183,12 @@ void kerneltrap() {
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if (which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING) yield();
+  // the bottom halves of device interrupts.
+  softirq();
+
+  // give up the CPU if this is a timer interrupt, unless it
+  // came while running bottom halves for a trap below.
+  if (which_dev == 2 && !mycpu()->insoftirq && myproc() != 0 && myproc()->state == RUNNING) yield();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -141,10 +199,20 @@ void kerneltrap() {
 void clockintr() {
   acquire(&tickslock);
   ticks++;
-  wakeup(&ticks);
   release(&tickslock);
 }
 
+// ask timervec for an extra timer interrupt on this hart at
+// r_time() when, ahead of the next tick; 0 cancels it. the
+// real-time scheduler uses this to end a budget or a period
+// between ticks. interrupts must be disabled.
+void clockat(uint64 when) {
+  uint64 *scratch = &mscratch0[32 * cpuid()];
+
+  scratch[9] = when;
+  if (when != 0 && when < scratch[8]) *(uint64 *)CLINT_MTIMECMP(cpuid()) = when;
+}
+
 // check if it's an external interrupt or software interrupt,
 // and handle it.
 // returns 2 if timer interrupt,
@@ -174,18 +242,29 @@ int devintr() {
 
     return 1;
   } else if (scause == 0x8000000000000001L) {
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
-
-    if (cpuid() == 0) {
-      clockintr();
-    }
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
 
     // acknowledge the software interrupt by clearing
-    // the SSIP bit in sip.
+    // the SSIP bit in sip, before looking for its causes,
+    // so that a later one raises it again.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    ipiintr();
+
+    // timervec sets scratch[7] when a tick is due.
+    int tick = __sync_lock_test_and_set(&mscratch0[32 * cpuid() + 7], 0);
+    if (tick) {
+      if (cpuid() == 0) {
+        clockintr();
+      }
+      timertick();
+    }
+
+    // or it may be time for a real-time process; see clockat().
+    if (rtcheck()) tick = 1;
+
+    return tick ? 2 : 1;
   } else {
     return 0;
   }
@@ -8,6 +8,7 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "softirq.h"
 #include "defs.h"
 
 // the UART control registers are memory-mapped
@@ -39,12 +40,19 @@
 #define WriteReg(reg, v) (*(Reg(reg)) = (v))
 
 // the transmit output buffer.
-struct spinlock uart_tx_lock;
+struct spinlock uart_tx_lock __attribute__((aligned(CACHELINE)));
 #define UART_TX_BUF_SIZE 32
 char uart_tx_buf[UART_TX_BUF_SIZE];
 int uart_tx_w;  // write next to uart_tx_buf[uart_tx_w++]
 int uart_tx_r;  // read next from uart_tx_buf[uar_tx_r++]
 
+// input read by uartintr() for uartbh().
+struct spinlock uart_rx_lock __attribute__((aligned(CACHELINE)));
+#define UART_RX_BUF_SIZE 128
+char uart_rx_buf[UART_RX_BUF_SIZE];
+uint uart_rx_w;  // uartintr() writes uart_rx_buf[uart_rx_w++ % SIZE]
+uint uart_rx_r;  // uartbh() reads uart_rx_buf[uart_rx_r++ % SIZE]
+
 extern volatile int panicked;  // from printf.c
 
 void uartstart();
@@ -73,6 +81,7 @@ void uartinit(void) {
   WriteReg(IER, IER_TX_ENABLE | IER_RX_ENABLE);
 
   initlock(&uart_tx_lock, "uart");
+  initlock(&uart_rx_lock, "uart_rx");
 }
 
 // add a character to the output buffer and tell the
@@ -125,16 +134,11 @@ void uartputc_sync(int c) {
 }
 
 // if the UART is idle, and a character is waiting
-// in the transmit buffer, send it.
+// in the transmit buffer or the kernel log, send it.
 // caller must hold uart_tx_lock.
 // called from both the top- and bottom-half.
 void uartstart() {
   while (1) {
-    if (uart_tx_w == uart_tx_r) {
-      // transmit buffer is empty.
-      return;
-    }
-
     if ((ReadReg(LSR) & LSR_TX_IDLE) == 0) {
       // the UART transmit holding register is full,
       // so we cannot give it another byte.
@@ -142,6 +146,14 @@ void uartstart() {
       return;
     }
 
+    if (uart_tx_w == uart_tx_r) {
+      // transmit buffer is empty; send kernel messages.
+      int c = klogc();
+      if (c < 0) return;
+      WriteReg(THR, c);
+      continue;
+    }
+
     int c = uart_tx_buf[uart_tx_r];
     uart_tx_r = (uart_tx_r + 1) % UART_TX_BUF_SIZE;
 
@@ -152,6 +164,26 @@ void uartstart() {
   }
 }
 
+// printf() has added to a drained kernel log; if the UART
+// is idle, start it. unlike uartstart() this wakes no one
+// and never waits for the lock, so printf() can be called
+// with any lock held. if the lock is busy, its holder may
+// already have found the log empty, so have this hart's
+// bottom half look again.
+void uartkick(void) {
+  int c;
+
+  push_off();
+  if (holding(&uart_tx_lock) || !tryacquire(&uart_tx_lock)) {
+    raise_softirq(SOFTIRQ_UART);
+    pop_off();
+    return;
+  }
+  if (uart_tx_w == uart_tx_r && (ReadReg(LSR) & LSR_TX_IDLE) && (c = klogc()) >= 0) WriteReg(THR, c);
+  release(&uart_tx_lock);
+  pop_off();
+}
+
 // read one input character from the UART.
 // return -1 if none is waiting.
 int uartgetc(void) {
@@ -165,16 +197,36 @@ int uartgetc(void) {
 
 // handle a uart interrupt, raised because input has
 // arrived, or the uart is ready for more output, or
-// both. called from trap.c.
+// both. called from trap.c. this is the top half: it
+// only quiets the uart, and leaves the rest to uartbh().
 void uartintr(void) {
-  // read and process incoming characters.
-  while (1) {
-    int c = uartgetc();
-    if (c == -1) break;
-    consoleintr(c);
+  int c;
+
+  // take the incoming characters; drop them if uartbh()
+  // has fallen that far behind.
+  acquire(&uart_rx_lock);
+  while ((c = uartgetc()) != -1) {
+    if (uart_rx_w - uart_rx_r < UART_RX_BUF_SIZE) uart_rx_buf[uart_rx_w++ % UART_RX_BUF_SIZE] = c;
   }
+  release(&uart_rx_lock);
+
+  // reading ISR acknowledges a ready-for-output interrupt.
+  ReadReg(ISR);
+
+  raise_softirq(SOFTIRQ_UART);
+}
+
+// the bottom half: process the characters that have come
+// in, and send buffered ones.
+void uartbh(void) {
+  char buf[UART_RX_BUF_SIZE];
+  int n = 0;
+
+  acquire(&uart_rx_lock);
+  while (uart_rx_r != uart_rx_w) buf[n++] = uart_rx_buf[uart_rx_r++ % UART_RX_BUF_SIZE];
+  release(&uart_rx_lock);
+  for (int i = 0; i < n; i++) consoleintr(buf[i]);
 
-  // send buffered characters.
   acquire(&uart_tx_lock);
   uartstart();
   release(&uart_tx_lock);
@@ -16,6 +16,7 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "softirq.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -42,7 +43,9 @@ static struct disk {
     char status;
   } info[NUM];
 
-  struct spinlock vdisk_lock;
+  struct spinlock vdisk_lock __attribute__((aligned(CACHELINE)));
+
+  uint nread, nwrite;  // requests started
 
 } __attribute__((aligned(PGSIZE))) disk;
 
@@ -151,6 +154,11 @@ void virtio_disk_rw(struct buf *b, int write) {
   uint64 sector = b->blockno * (BSIZE / 512);
 
   acquire(&disk.vdisk_lock);
+  plic_steer(VIRTIO0_IRQ);
+  if (write)
+    disk.nwrite++;
+  else
+    disk.nread++;
 
   // the spec says that legacy block operations use three
   // descriptors: one for type/reserved/sector, one for
@@ -203,7 +211,7 @@ void virtio_disk_rw(struct buf *b, int write) {
   disk.desc[idx[2]].flags = VRING_DESC_F_WRITE;  // device writes the status
   disk.desc[idx[2]].next = 0;
 
-  // record struct buf for virtio_disk_intr().
+  // record struct buf for virtio_disk_bh().
   b->disk = 1;
   disk.info[idx[0]].b = b;
 
@@ -217,7 +225,7 @@ void virtio_disk_rw(struct buf *b, int write) {
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0;  // value is queue number
 
-  // Wait for virtio_disk_intr() to say request has finished.
+  // Wait for virtio_disk_bh() to say request has finished.
   while (b->disk == 1) {
     sleep(b, &disk.vdisk_lock);
   }
@@ -228,20 +236,35 @@ void virtio_disk_rw(struct buf *b, int write) {
   release(&disk.vdisk_lock);
 }
 
+// the top half: acknowledge the interrupt, and leave the
+// completions to virtio_disk_bh(). a completion that comes
+// after the acknowledgement interrupts again.
 void virtio_disk_intr() {
+  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
+  raise_softirq(SOFTIRQ_DISK);
+}
+
+// the bottom half: wake the waiters for all the requests
+// the device has finished.
+void virtio_disk_bh() {
   acquire(&disk.vdisk_lock);
 
   while ((disk.used_idx % NUM) != (disk.used->id % NUM)) {
     int id = disk.used->elems[disk.used_idx].id;
 
-    if (disk.info[id].status != 0) panic("virtio_disk_intr status");
+    if (disk.info[id].status != 0) panic("virtio_disk_bh status");
 
     disk.info[id].b->disk = 0;  // disk is done with buf
     wakeup(disk.info[id].b);
 
     disk.used_idx = (disk.used_idx + 1) % NUM;
   }
-  *R(VIRTIO_MMIO_INTERRUPT_ACK) = *R(VIRTIO_MMIO_INTERRUPT_STATUS) & 0x3;
 
   release(&disk.vdisk_lock);
 }
+
+// Report how many reads and writes have been started.
+void diskstats(uint *nread, uint *nwrite) {
+  *nread = disk.nread;
+  *nwrite = disk.nwrite;
+}
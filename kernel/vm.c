@@ -3,6 +3,8 @@
 #include "memlayout.h"
 #include "elf.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
 #include "defs.h"
 #include "fs.h"
 
@@ -15,6 +17,53 @@ extern char etext[];  // kernel.ld sets this to end of kernel code.
 
 extern char trampoline[];  // trampoline.S
 
+// user memory is allocated on demand; see uvmfault(). until a
+// page is written, reading it maps this one, read-only, and
+// fork() shares that mapping. it isn't counted as rss.
+static char zeropage[PGSIZE] __attribute__((aligned(PGSIZE)));
+
+// a user page table keeps the pages it holds in its root page,
+// in entries for addresses at or above MAXVA, which are never
+// walked; the counts are shifted clear of PTE_V. only the one
+// process that owns the page table changes them.
+#define ROOT_RSS 510      // leaf pages mapped, but not the shared trampoline
+#define ROOT_PTPAGES 511  // page-table pages, the root included
+
+// add rss and ptpages to a user page table's counts; the
+// kernel page table has none.
+static void count(pagetable_t pagetable, int rss, int ptpages) {
+  if (pagetable == kernel_pagetable) return;
+  pagetable[ROOT_RSS] += (uint64)rss << 1;
+  pagetable[ROOT_PTPAGES] += (uint64)ptpages << 1;
+}
+
+// Pages held by a user page table: leaf pages mapped in it,
+// and its page-table pages.
+void uvmusage(pagetable_t pagetable, uint64 *rss, uint64 *ptpages) {
+  *rss = pagetable[ROOT_RSS] >> 1;
+  *ptpages = pagetable[ROOT_PTPAGES] >> 1;
+}
+
+// Page-table pages that growing user memory from oldsz to
+// newsz would add.
+uint64 uvmptcost(pagetable_t pagetable, uint64 oldsz, uint64 newsz) {
+  uint64 a, n = 0, last = -1;
+  pagetable_t l1;
+
+  for (a = PGROUNDUP(oldsz); a < newsz; a = (a | (PGSIZE * 512 - 1)) + 1) {
+    if ((pagetable[PX(2, a)] & PTE_V) == 0) {
+      // a new level-1 page, once, and a level-0 page.
+      if (PX(2, a) != last) n++;
+      last = PX(2, a);
+      n++;
+      continue;
+    }
+    l1 = (pagetable_t)PTE2PA(pagetable[PX(2, a)]);
+    if ((l1[PX(1, a)] & PTE_V) == 0) n++;
+  }
+  return n;
+}
+
 /*
  * create a direct-map page table for the kernel.
  */
@@ -65,6 +114,8 @@ void kvminithart() {
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
 pte_t *walk(pagetable_t pagetable, uint64 va, int alloc) {
+  pagetable_t root = pagetable;
+
   if (va >= MAXVA) panic("walk");
 
   for (int level = 2; level > 0; level--) {
@@ -75,6 +126,7 @@ pte_t *walk(pagetable_t pagetable, uint64 va, int alloc) {
       if (!alloc || (pagetable = (pde_t *)kalloc()) == 0) return 0;
       memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
+      count(root, 0, 1);
     }
   }
   return &pagetable[PX(0, va)];
@@ -125,50 +177,109 @@ uint64 kvmpa(uint64 va) {
 // be page-aligned. Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
 int mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm) {
-  uint64 a, last;
+  uint64 a, last, pa0 = pa;
   pte_t *pte;
+  int n = 0, ret = 0;
 
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   for (;;) {
-    if ((pte = walk(pagetable, a, 1)) == 0) return -1;
+    if ((pte = walk(pagetable, a, 1)) == 0) {
+      ret = -1;
+      break;
+    }
     if (*pte & PTE_V) panic("remap");
     *pte = PA2PTE(pa) | perm | PTE_V;
+    n++;
     if (a == last) break;
     a += PGSIZE;
     pa += PGSIZE;
   }
-  return 0;
+  if (va != TRAMPOLINE && pa0 != (uint64)zeropage) count(pagetable, n, 0);
+  return ret;
 }
 
 // Remove npages of mappings starting from va. va must be
-// page-aligned. The mappings must exist.
-// Optionally free the physical memory.
+// page-aligned. Pages never touched have no mapping to
+// remove. Optionally free the physical memory, but never
+// the zero page.
 void uvmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free) {
-  uint64 a;
+  uint64 a, pa;
   pte_t *pte;
+  int remote, n = 0;
 
   if ((va % PGSIZE) != 0) panic("uvmunmap: not aligned");
 
+  // if another hart may be using the pages through its TLB,
+  // invalidate the PTEs, shoot down its TLB, and only then
+  // free the pages.
+  remote = do_free && tlbremote(pagetable);
+
   for (a = va; a < va + npages * PGSIZE; a += PGSIZE) {
-    if ((pte = walk(pagetable, a, 0)) == 0) panic("uvmunmap: walk");
-    if ((*pte & PTE_V) == 0) panic("uvmunmap: not mapped");
+    if ((pte = walk(pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0) continue;
     if (PTE_FLAGS(*pte) == PTE_V) panic("uvmunmap: not a leaf");
-    if (do_free) {
-      uint64 pa = PTE2PA(*pte);
-      kfree((void *)pa);
+    pa = PTE2PA(*pte);
+    if (pa != (uint64)zeropage) n++;
+    if (remote) {
+      *pte &= ~PTE_V;
+      continue;
     }
+    if (do_free && pa != (uint64)zeropage) kfree((void *)pa);
+    *pte = 0;
+  }
+  if (va != TRAMPOLINE) count(pagetable, -n, 0);
+  if (!remote) return;
+
+  tlbshootdown(pagetable);
+  for (a = va; a < va + npages * PGSIZE; a += PGSIZE) {
+    if ((pte = walk(pagetable, a, 0)) == 0 || *pte == 0) continue;
+    if ((pa = PTE2PA(*pte)) != (uint64)zeropage) kfree((void *)pa);
     *pte = 0;
   }
 }
 
+// Handle a page fault at va in p's user memory: a read of a
+// page never touched maps the zero page, and the first write
+// to one, or instruction fetch from one, gets a private zeroed
+// page, if p's RLIMIT_RSS allows. Returns -1 if va is not such
+// a page, or memory has run out.
+int uvmfault(struct proc *p, uint64 va, int write) {
+  pagetable_t pagetable = p->pagetable;
+  pte_t *pte;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  if (va >= p->sz) return -1;
+  pte = walk(pagetable, va, 0);
+  if (pte && (*pte & PTE_V) && (!write || (*pte & PTE_U) == 0 || PTE2PA(*pte) != (uint64)zeropage)) return -1;
+  if (!write) return mappages(pagetable, va, PGSIZE, (uint64)zeropage, PTE_R | PTE_U);
+
+  if (overlimit(p, 1) || (mem = kalloc()) == 0) return -1;
+  memset(mem, 0, PGSIZE);
+  if (pte && (*pte & PTE_V)) {
+    // the zero page was mapped; no other hart can be using
+    // this page table, a process's only thread being here.
+    *pte = PA2PTE(mem) | PTE_W | PTE_X | PTE_R | PTE_U | PTE_V;
+    count(pagetable, 1, 0);
+    sfence_vma();
+    return 0;
+  }
+  if (mappages(pagetable, va, PGSIZE, (uint64)mem, PTE_W | PTE_X | PTE_R | PTE_U) != 0) {
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
 // create an empty user page table.
 // returns 0 if out of memory.
 pagetable_t uvmcreate() {
   pagetable_t pagetable;
+
   pagetable = (pagetable_t)kalloc();
   if (pagetable == 0) return 0;
   memset(pagetable, 0, PGSIZE);
+  count(pagetable, 0, 1);
   return pagetable;
 }
 
@@ -253,7 +364,8 @@ void uvmfree(pagetable_t pagetable, uint64 sz) {
 // Given a parent process's page table, copy
 // its memory into a child's page table.
 // Copies both the page table and the
-// physical memory.
+// physical memory, but shares the zero page,
+// and leaves pages never touched untouched.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz) {
@@ -263,10 +375,13 @@ int uvmcopy(pagetable_t old, pagetable_t new, uint64 sz) {
   char *mem;
 
   for (i = 0; i < sz; i += PGSIZE) {
-    if ((pte = walk(old, i, 0)) == 0) panic("uvmcopy: pte should exist");
-    if ((*pte & PTE_V) == 0) panic("uvmcopy: page not present");
+    if ((pte = walk(old, i, 0)) == 0 || (*pte & PTE_V) == 0) continue;
     pa = PTE2PA(*pte);
     flags = PTE_FLAGS(*pte);
+    if (pa == (uint64)zeropage) {
+      if (mappages(new, i, PGSIZE, pa, flags) != 0) goto err;
+      continue;
+    }
     if ((mem = kalloc()) == 0) goto err;
     memmove(mem, (char *)pa, PGSIZE);
     if (mappages(new, i, PGSIZE, (uint64)mem, flags) != 0) {
@@ -291,6 +406,20 @@ void uvmclear(pagetable_t pagetable, uint64 va) {
   *pte &= ~PTE_U;
 }
 
+// The physical address of user page va, to be read or
+// written by the kernel, faulting it in as the process
+// would if it is the current process's.
+static uint64 useraddr(pagetable_t pagetable, uint64 va, int write) {
+  struct proc *p = myproc();
+  uint64 pa = walkaddr(pagetable, va);
+
+  if ((pa == 0 || (write && pa == (uint64)zeropage)) && p && p->pagetable == pagetable &&
+      uvmfault(p, va, write) == 0)
+    pa = walkaddr(pagetable, va);
+  if (write && pa == (uint64)zeropage) return 0;
+  return pa;
+}
+
 // Copy from kernel to user.
 // Copy len bytes from src to virtual address dstva in a given page table.
 // Return 0 on success, -1 on error.
@@ -299,7 +428,7 @@ int copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len) {
 
   while (len > 0) {
     va0 = PGROUNDDOWN(dstva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = useraddr(pagetable, va0, 1);
     if (pa0 == 0) return -1;
     n = PGSIZE - (dstva - va0);
     if (n > len) n = len;
@@ -320,7 +449,7 @@ int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len) {
 
   while (len > 0) {
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = useraddr(pagetable, va0, 0);
     if (pa0 == 0) return -1;
     n = PGSIZE - (srcva - va0);
     if (n > len) n = len;
@@ -333,41 +462,45 @@ int copyin(pagetable_t pagetable, char *dst, uint64 srcva, uint64 len) {
   return 0;
 }
 
+#define ONES 0x0101010101010101UL
+#define HIGH 0x8080808080808080UL
+
+// Is there a zero byte in x?
+#define HASZERO(x) (((x)-ONES) & ~(x) & HIGH)
+
 // Copy a null-terminated string from user to kernel.
 // Copy bytes to dst from virtual address srcva in a given page table,
 // until a '\0', or max.
 // Return 0 on success, -1 on error.
 int copyinstr(pagetable_t pagetable, char *dst, uint64 srcva, uint64 max) {
-  uint64 n, va0, pa0;
-  int got_null = 0;
+  uint64 n, va0, pa0, w;
+  int i;
 
-  while (got_null == 0 && max > 0) {
+  while (max > 0) {
     va0 = PGROUNDDOWN(srcva);
-    pa0 = walkaddr(pagetable, va0);
+    pa0 = useraddr(pagetable, va0, 0);
     if (pa0 == 0) return -1;
     n = PGSIZE - (srcva - va0);
     if (n > max) n = max;
+    max -= n;
 
     char *p = (char *)(pa0 + (srcva - va0));
-    while (n > 0) {
-      if (*p == '\0') {
-        *dst = '\0';
-        got_null = 1;
-        break;
+    srcva = va0 + PGSIZE;
+    // a byte at a time until p is aligned, then a word at a
+    // time until a word has a NUL in it.
+    for (; n > 0 && (uint64)p % 8 != 0; n--, p++, dst++)
+      if ((*dst = *p) == '\0') return 0;
+    for (; n >= 8; n -= 8, p += 8, dst += 8) {
+      w = *(uint64 *)p;
+      if (HASZERO(w)) break;
+      if ((uint64)dst % 8 == 0) {
+        *(uint64 *)dst = w;
       } else {
-        *dst = *p;
+        for (i = 0; i < 8; i++) dst[i] = w >> (8 * i);
       }
-      --n;
-      --max;
-      p++;
-      dst++;
     }
-
-    srcva = va0 + PGSIZE;
-  }
-  if (got_null) {
-    return 0;
-  } else {
-    return -1;
+    for (; n > 0; n--, p++, dst++)
+      if ((*dst = *p) == '\0') return 0;
   }
+  return -1;
 }
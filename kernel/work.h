@@ -0,0 +1,9 @@
+// Deferred work, run by a per-CPU kernel worker thread.
+// Include timer.h first.
+struct work {
+  void (*fn)(struct work *);  // run by the worker, which may sleep
+  void *arg;                  // for fn
+  struct work *next;          // in the queue
+  int queued;                 // on a queue, or on a timer for one
+  struct timer timer;         // for queue_delayed_work()
+};
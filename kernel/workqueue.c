@@ -0,0 +1,111 @@
+//
+// per-CPU work queues.
+//
+// each hart has a kernel thread, kworker<hart>, pinned to it.
+// queue_work() puts work on the queue of the hart that calls
+// it, and that hart's worker runs it in process context,
+// where it may sleep and take sleep locks. so an interrupt
+// handler, or a system call that need not wait for a job,
+// can leave the job to a worker.
+//
+
+#include "types.h"
+#include "param.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "timer.h"
+#include "work.h"
+#include "defs.h"
+
+struct workqueue {
+  struct spinlock lock;
+  struct work *head;
+  struct work **tail;
+  struct proc *worker;
+  uint ndone;  // work run
+} __attribute__((aligned(CACHELINE))) wqs[NCPU];
+
+static void worker(void *arg) {
+  struct workqueue *q = arg;
+  struct work *w;
+
+  for (;;) {
+    acquire(&q->lock);
+    while ((w = q->head) == 0) sleep(q, &q->lock);
+    if ((q->head = w->next) == 0) q->tail = &q->head;
+    release(&q->lock);
+
+    // fn may queue w again.
+    __sync_lock_release(&w->queued);
+    w->fn(w);
+    q->ndone++;
+  }
+}
+
+void workinit(void) {
+  for (int i = 0; i < NCPU; i++) {
+    initlock(&wqs[i].lock, "workqueue");
+    wqs[i].tail = &wqs[i].head;
+  }
+}
+
+// start this hart's worker. work queued before then waits.
+void workerinit(void) {
+  int id = cpuid();
+  struct workqueue *q = &wqs[id];
+  char name[16] = "kworker";
+
+  name[7] = '0' + id;
+  q->worker = kthread(name, worker, q, 1UL << id);
+}
+
+// put w, already marked queued, on this hart's queue.
+static void enqueue(struct work *w) {
+  struct workqueue *q;
+
+  push_off();
+  q = &wqs[cpuid()];
+  acquire(&q->lock);
+  w->next = 0;
+  *q->tail = w;
+  q->tail = &w->next;
+  release(&q->lock);
+  if (q->worker) wakeproc(q->worker, q);
+  pop_off();
+}
+
+// run w->fn(w) soon, on this hart's worker. returns 0 if w
+// was already queued. the caller may hold other processes'
+// locks, as allocproc() does when kalloc() queues reclaim:
+// the worker's lock is taken last, and nothing that holds it
+// waits for another process's lock (the scheduler only tries
+// them).
+int queue_work(struct work *w) {
+  if (__sync_lock_test_and_set(&w->queued, 1)) return 0;
+  enqueue(w);
+  return 1;
+}
+
+static void fire(struct timer *t) { enqueue(t->arg); }
+
+// queue w in delay ticks, on this hart. returns 0 if w was
+// already queued.
+int queue_delayed_work(struct work *w, uint delay) {
+  if (__sync_lock_test_and_set(&w->queued, 1)) return 0;
+  w->timer.fn = fire;
+  w->timer.arg = w;
+  timer_add(&w->timer, ticks + delay);
+  return 1;
+}
+
+// take w off its timer before it is queued. returns 0 if it
+// was not waiting on one.
+int cancel_delayed_work(struct work *w) {
+  if (!timer_del(&w->timer)) return 0;
+  __sync_lock_release(&w->queued);
+  return 1;
+}
+
+// work run by hart's worker.
+uint workdone(int hart) { return wqs[hart].ndone; }
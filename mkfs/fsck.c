@@ -0,0 +1,473 @@
+// Offline file system checker for xv6 fs.img.
+//
+// fsck maps the image with mmap() and checks, in order:
+//   the super block (magic and disk layout),
+//   the log (a committed transaction is replayed, as at boot),
+//   the inode table and every block pointer in it,
+//   the directory tree (".", "..", link counts, orphans),
+//   the free block bit map (leaked and missing blocks).
+// The inode and bit map passes are split across threads.
+//
+// Usage: fsck [-n | -y] [-j nthreads] fs.img
+//   -n  check only (default). The image is mapped private, so
+//       repairs are still made, in memory, and later passes see
+//       their effect, but nothing is written back.
+//   -y  repair: replay the log, free orphans, fix link counts and bit map.
+//
+// Exit status: 0 clean, 1 errors corrected, 4 errors left, 8 usage or I/O.
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#define stat xv6_stat  // avoid clash with host struct stat
+#include "kernel/types.h"
+#include "kernel/fs.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#undef stat
+
+#include <sys/stat.h>
+
+#define MAXTHREAD 64
+
+int repair;    // -y given
+int nthread;   // worker threads for the parallel passes
+uchar *img;    // the mapped image
+uint64 imgsz;  // bytes in the image file
+struct superblock sb;
+uint datastart;  // first data block, after the bit map
+
+uchar *itype;  // validated inode types; 0 if free
+ushort *iref;  // directory entries naming each inode, except "."
+uint *dot;     // inode named by each directory's "." entry
+uint *dotdot;  // inode named by each directory's ".." entry
+uint *parent;  // directory that holds each directory's entry
+ushort *bref;  // inode pointers to each block
+
+int nerror;  // problems found
+int nfixed;  // problems repaired
+
+// convert from intel byte order; the image is little-endian.
+ushort xshort(ushort x) {
+  uchar *a = (uchar *)&x;
+  return a[0] | (a[1] << 8);
+}
+
+uint xint(uint x) {
+  uchar *a = (uchar *)&x;
+  return a[0] | (a[1] << 8) | (a[2] << 16) | ((uint)a[3] << 24);
+}
+
+uchar *block(uint b) { return img + (uint64)b * BSIZE; }
+
+struct dinode *dinode(uint inum) {
+  return (struct dinode *)block(IBLOCK(inum, sb)) + (inum % IPB);
+}
+
+// Report a problem; the counters are shared by the worker threads.
+void problem(int fixed, char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+void problem(int fixed, char *fmt, ...) {
+  va_list ap;
+
+  flockfile(stdout);
+  va_start(ap, fmt);
+  vprintf(fmt, ap);
+  va_end(ap);
+  printf(fixed ? " (fixed)\n" : "\n");
+  funlockfile(stdout);
+  __sync_fetch_and_add(&nerror, 1);
+  if (fixed) __sync_fetch_and_add(&nfixed, 1);
+}
+
+// Run fn(lo, hi) over [0, n) split into nthread ranges.
+void parallel(void *(*fn)(void *), uint n) {
+  pthread_t tid[MAXTHREAD];
+  uint range[MAXTHREAD][2];
+  uint chunk = (n + nthread - 1) / nthread;
+  int i;
+
+  for (i = 0; i < nthread; i++) {
+    range[i][0] = i * chunk < n ? i * chunk : n;
+    range[i][1] = (i + 1) * chunk < n ? (i + 1) * chunk : n;
+    if (pthread_create(&tid[i], 0, fn, range[i]) != 0) {
+      perror("pthread_create");
+      exit(8);
+    }
+  }
+  for (i = 0; i < nthread; i++) pthread_join(tid[i], 0);
+}
+
+// Super block.
+
+void checksb(void) {
+  uint ninodeblocks, nbitmap;
+
+  memmove(&sb, block(1), sizeof(sb));
+  sb.magic = xint(sb.magic);
+  sb.size = xint(sb.size);
+  sb.nblocks = xint(sb.nblocks);
+  sb.ninodes = xint(sb.ninodes);
+  sb.nlog = xint(sb.nlog);
+  sb.logstart = xint(sb.logstart);
+  sb.inodestart = xint(sb.inodestart);
+  sb.bmapstart = xint(sb.bmapstart);
+
+  printf("superblock: size %u nblocks %u ninodes %u nlog %u logstart %u inodestart %u bmapstart %u\n", sb.size,
+         sb.nblocks, sb.ninodes, sb.nlog, sb.logstart, sb.inodestart, sb.bmapstart);
+
+  ninodeblocks = (sb.ninodes + IPB - 1) / IPB;
+  nbitmap = sb.size / BPB + 1;
+  datastart = sb.bmapstart + nbitmap;
+
+  if (sb.magic != FSMAGIC) {
+    fprintf(stderr, "fsck: bad magic %x\n", sb.magic);
+    exit(8);
+  }
+  if ((uint64)sb.size * BSIZE > imgsz) {
+    fprintf(stderr, "fsck: image holds %lu blocks, superblock says %u\n", imgsz / BSIZE, sb.size);
+    exit(8);
+  }
+  if (sb.logstart < 2 || sb.nlog < 2 || sb.inodestart < sb.logstart + sb.nlog ||
+      sb.bmapstart < sb.inodestart + ninodeblocks || datastart > sb.size || sb.ninodes <= ROOTINO) {
+    fprintf(stderr, "fsck: inconsistent disk layout\n");
+    exit(8);
+  }
+  if (sb.nblocks != sb.size - datastart)
+    problem(0, "superblock: nblocks %u, layout leaves %u data blocks", sb.nblocks, sb.size - datastart);
+}
+
+// Log.
+
+// Header block, as written by log.c.
+struct logheader {
+  int n;
+  int block[LOGSIZE];
+};
+
+void checklog(void) {
+  struct logheader *lh = (struct logheader *)block(sb.logstart);
+  int i, n = xint(lh->n);
+
+  if (n == 0) return;
+
+  if (n < 0 || n >= sb.nlog || n > LOGSIZE) {
+    problem(repair, "log: header claims %d blocks, log holds %u; transaction discarded", n, sb.nlog - 1);
+    lh->n = 0;
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    uint b = xint(lh->block[i]);
+    if (b < sb.inodestart || b >= sb.size) {
+      problem(repair, "log: entry %d names block %u outside inodes and data; transaction discarded", i, b);
+      lh->n = 0;
+      return;
+    }
+  }
+
+  // A non-zero header is a committed transaction that was not
+  // installed. That is not an error; do what recover_from_log()
+  // does at boot so the checks below see the committed state.
+  printf("log: replaying committed transaction of %d blocks\n", n);
+  for (i = 0; i < n; i++) memmove(block(xint(lh->block[i])), block(sb.logstart + 1 + i), BSIZE);
+  lh->n = 0;
+}
+
+// Inodes.
+
+// First pass: validate each inode's type, so that the
+// second pass can tell whether a directory entry names
+// an allocated inode.
+void *scantypes(void *arg) {
+  uint *r = arg;
+  uint inum;
+
+  for (inum = r[0]; inum < r[1]; inum++) {
+    struct dinode *dip = dinode(inum);
+    short type = xshort(dip->type);
+
+    if (inum == 0 || type == 0) continue;
+    if (type != T_DIR && type != T_FILE && type != T_DEVICE) {
+      problem(repair, "inode %u: bad type %d; cleared", inum, type);
+      memset(dip, 0, sizeof(*dip));
+      continue;
+    }
+    itype[inum] = type;
+  }
+  return 0;
+}
+
+// Account for block pointer *bp of inode inum.
+// Returns the block number, or 0 if none or cleared.
+uint claim(uint inum, uint *bp) {
+  uint b = xint(*bp);
+
+  if (b == 0) return 0;
+  if (b < datastart || b >= sb.size) {
+    problem(repair, "inode %u: block %u outside data area", inum, b);
+    *bp = 0;
+    return 0;
+  }
+  __sync_fetch_and_add(&bref[b], 1);
+  return b;
+}
+
+// Return the directory entry at byte offset off of
+// directory dip, or 0 if its block is missing.
+struct dirent *direntat(struct dinode *dip, uint off) {
+  uint bn = off / BSIZE, b = 0;
+
+  if (bn < NDIRECT) {
+    b = xint(dip->addrs[bn]);
+  } else if (bn < MAXFILE) {
+    uint ib = xint(dip->addrs[NDIRECT]);
+    if (ib >= datastart && ib < sb.size) b = xint(((uint *)block(ib))[bn - NDIRECT]);
+  }
+  if (b < datastart || b >= sb.size) return 0;  // reported by claim()
+  return (struct dirent *)(block(b) + off % BSIZE);
+}
+
+void scandir(uint inum, struct dinode *dip) {
+  uint off, size = xint(dip->size);
+  struct dirent *de;
+
+  if (size % sizeof(*de) != 0) problem(0, "directory %u: size %u not a multiple of %d", inum, size, (int)sizeof(*de));
+
+  for (off = 0; off + sizeof(*de) <= size; off += sizeof(*de)) {
+    if ((de = direntat(dip, off)) == 0) continue;
+    uint child = xshort(de->inum);
+    if (child == 0) continue;
+
+    if (child >= sb.ninodes || itype[child] == 0) {
+      problem(repair, "directory %u: entry %.*s names free inode %u; removed", inum, DIRSIZ, de->name, child);
+      memset(de, 0, sizeof(*de));
+      continue;
+    }
+    if (strncmp(de->name, ".", DIRSIZ) == 0) {
+      dot[inum] = child;
+      continue;
+    }
+    if (strncmp(de->name, "..", DIRSIZ) == 0) {
+      dotdot[inum] = child;
+    } else if (itype[child] == T_DIR && __sync_val_compare_and_swap(&parent[child], 0, inum) != 0) {
+      problem(0, "directory %u: entry %.*s is a second link to directory %u", inum, DIRSIZ, de->name, child);
+    }
+    __sync_fetch_and_add(&iref[child], 1);
+  }
+}
+
+// Second pass: claim data blocks and walk directories.
+void *scaninodes(void *arg) {
+  uint *r = arg;
+  uint inum, i;
+
+  for (inum = r[0]; inum < r[1]; inum++) {
+    struct dinode *dip = dinode(inum);
+
+    if (itype[inum] == 0) continue;
+
+    if (xint(dip->size) > MAXFILE * BSIZE) problem(0, "inode %u: size %u too large", inum, xint(dip->size));
+
+    for (i = 0; i < NDIRECT; i++) claim(inum, &dip->addrs[i]);
+    uint ib = claim(inum, &dip->addrs[NDIRECT]);
+    if (ib) {
+      uint *indirect = (uint *)block(ib);
+      for (i = 0; i < NINDIRECT; i++) claim(inum, &indirect[i]);
+    }
+
+    if (itype[inum] == T_DIR) scandir(inum, dip);
+  }
+  return 0;
+}
+
+// Free an orphaned inode: drop the references its
+// directory entries held and release its blocks.
+void freeinode(uint inum) {
+  struct dinode *dip = dinode(inum);
+  struct dirent *de;
+  uint off, i, b;
+
+  if (itype[inum] == T_DIR) {
+    for (off = 0; off + sizeof(*de) <= xint(dip->size); off += sizeof(*de)) {
+      if ((de = direntat(dip, off)) == 0 || (b = xshort(de->inum)) == 0 || b >= sb.ninodes) continue;
+      if (strncmp(de->name, ".", DIRSIZ) == 0) continue;
+      iref[b]--;
+      if (parent[b] == inum && strncmp(de->name, "..", DIRSIZ) != 0) parent[b] = 0;
+    }
+  }
+
+  for (i = 0; i < NDIRECT; i++)
+    if ((b = xint(dip->addrs[i])) >= datastart && b < sb.size) bref[b]--;
+  if ((b = xint(dip->addrs[NDIRECT])) >= datastart && b < sb.size) {
+    uint *indirect = (uint *)block(b);
+    for (i = 0; i < NINDIRECT; i++)
+      if ((b = xint(indirect[i])) >= datastart && b < sb.size) bref[b]--;
+    bref[xint(dip->addrs[NDIRECT])]--;
+  }
+  memset(dip, 0, sizeof(*dip));
+  itype[inum] = 0;
+}
+
+// Return 1 if following parent[] from directory inum, the
+// first directory found with an entry naming each, reaches
+// the root.
+int connected(uint inum) {
+  uint n;
+
+  for (n = 0; n < sb.ninodes; n++) {
+    if (inum == ROOTINO) return 1;
+    if (parent[inum] == 0) return 0;
+    inum = parent[inum];
+  }
+  return 0;  // cycle
+}
+
+void checktree(void) {
+  uint inum, changed;
+
+  if (itype[ROOTINO] != T_DIR) {
+    fprintf(stderr, "fsck: root inode is not a directory\n");
+    exit(8);
+  }
+
+  for (inum = 1; inum < sb.ninodes; inum++) {
+    if (itype[inum] != T_DIR) continue;
+    if (dot[inum] != inum) problem(0, "directory %u: \".\" names %u", inum, dot[inum]);
+    uint want = inum == ROOTINO ? ROOTINO : parent[inum];
+    if (want && dotdot[inum] != want) problem(0, "directory %u: \"..\" names %u, not %u", inum, dotdot[inum], want);
+    if (want && inum != ROOTINO && !connected(inum)) problem(0, "directory %u: not connected to the root", inum);
+  }
+
+  // An inode that no directory entry names is an orphan,
+  // e.g. a file unlinked while open when the system stopped.
+  // A directory's children name it in "..", so for directories
+  // only an entry in a parent counts.
+  // Freeing an orphan directory can orphan its children,
+  // so repeat until nothing changes.
+  do {
+    changed = 0;
+    for (inum = ROOTINO + 1; inum < sb.ninodes; inum++) {
+      if (itype[inum] == 0) continue;
+      if (itype[inum] == T_DIR ? parent[inum] != 0 : iref[inum] != 0) continue;
+      problem(repair, "inode %u: orphan, type %d nlink %d size %u; freed", inum, itype[inum],
+              (short)xshort(dinode(inum)->nlink), xint(dinode(inum)->size));
+      freeinode(inum);
+      changed = 1;
+    }
+  } while (changed);
+
+  for (inum = 1; inum < sb.ninodes; inum++) {
+    if (itype[inum] == 0) continue;
+    struct dinode *dip = dinode(inum);
+    if (xshort(dip->nlink) != iref[inum]) {
+      problem(repair, "inode %u: nlink %d, %d directory entries", inum, (short)xshort(dip->nlink), iref[inum]);
+      dip->nlink = xshort(iref[inum]);
+    }
+  }
+}
+
+// Bit map.
+
+void *scanbitmap(void *arg) {
+  uint *r = arg;
+  uint b;
+
+  for (b = r[0]; b < r[1]; b++) {
+    uchar *bits = block(BBLOCK(b, sb)) + (b % BPB) / 8;
+    int m = 1 << (b % 8);
+    int used = b < datastart || bref[b] > 0;
+
+    if (bref[b] > 1) problem(0, "block %u: claimed by %d inodes", b, bref[b]);
+    if ((*bits & m) && !used) {
+      problem(repair, "block %u: marked in use but unreferenced; freed", b);
+      __sync_fetch_and_and(bits, ~m);
+    } else if (!(*bits & m) && used) {
+      problem(repair, "block %u: in use but marked free", b);
+      __sync_fetch_and_or(bits, m);
+    }
+  }
+  return 0;
+}
+
+void usage(void) {
+  fprintf(stderr, "Usage: fsck [-n | -y] [-j nthreads] fs.img\n");
+  exit(8);
+}
+
+int main(int argc, char *argv[]) {
+  struct stat st;
+  int fd, c;
+
+  nthread = sysconf(_SC_NPROCESSORS_ONLN);
+  while ((c = getopt(argc, argv, "nyj:")) != -1) {
+    switch (c) {
+      case 'n':
+        repair = 0;
+        break;
+      case 'y':
+        repair = 1;
+        break;
+      case 'j':
+        nthread = atoi(optarg);
+        break;
+      default:
+        usage();
+    }
+  }
+  if (optind != argc - 1) usage();
+  if (nthread < 1) nthread = 1;
+  if (nthread > MAXTHREAD) nthread = MAXTHREAD;
+
+  if ((fd = open(argv[optind], repair ? O_RDWR : O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+    perror(argv[optind]);
+    exit(8);
+  }
+  imgsz = st.st_size;
+  if (imgsz < 2 * BSIZE) {
+    fprintf(stderr, "fsck: %s: too small\n", argv[optind]);
+    exit(8);
+  }
+
+  // Without -y the mapping is private: the log replay and
+  // any other changes stay in memory, but later passes see them.
+  img = mmap(0, imgsz, PROT_READ | PROT_WRITE, repair ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+  if (img == MAP_FAILED) {
+    perror("mmap");
+    exit(8);
+  }
+
+  checksb();
+  checklog();
+
+  itype = calloc(sb.ninodes, sizeof(*itype));
+  iref = calloc(sb.ninodes, sizeof(*iref));
+  dot = calloc(sb.ninodes, sizeof(*dot));
+  dotdot = calloc(sb.ninodes, sizeof(*dotdot));
+  parent = calloc(sb.ninodes, sizeof(*parent));
+  bref = calloc(sb.size, sizeof(*bref));
+  if (!itype || !iref || !dot || !dotdot || !parent || !bref) {
+    perror("calloc");
+    exit(8);
+  }
+
+  parallel(scantypes, sb.ninodes);
+  parallel(scaninodes, sb.ninodes);
+  checktree();
+  parallel(scanbitmap, sb.size);
+
+  if (repair && msync(img, imgsz, MS_SYNC) < 0) {
+    perror("msync");
+    exit(8);
+  }
+
+  printf("fsck: %d inodes, %u blocks, %d threads: %d problems, %d fixed\n", sb.ninodes, sb.size, nthread, nerror,
+         nfixed);
+  if (nerror == 0) exit(0);
+  exit(nerror == nfixed ? 1 : 4);
+}
@@ -0,0 +1,104 @@
+// bench test [n]
+//
+// Time n rounds (default 100000) of a small kernel path and
+// print the mean time per round in nanoseconds.
+//
+//   null      getpid(), the cheapest system call
+//   pingpong  a byte to a child and back over two pipes
+//   parallel  null on every hart at once, one process pinned
+//             to each; run with different CPUS to see how it
+//             scales. if harts shared no cache lines it would
+//             take as long as null.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+static inline uint64 rdtime(void) {
+  uint64 x;
+  asm volatile("rdtime %0" : "=r"(x));
+  return x;
+}
+
+void null(int n) {
+  for (int i = 0; i < n; i++) getpid();
+}
+
+void pingpong(int n) {
+  int ping[2], pong[2], pid;
+  char c = 0;
+
+  if (pipe(ping) < 0 || pipe(pong) < 0) {
+    fprintf(2, "bench: pipe failed\n");
+    exit(1);
+  }
+  if ((pid = fork()) < 0) {
+    fprintf(2, "bench: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    close(ping[1]);
+    while (read(ping[0], &c, 1) == 1) write(pong[1], &c, 1);
+    exit(0);
+  }
+  for (int i = 0; i < n; i++) {
+    write(ping[1], &c, 1);
+    read(pong[0], &c, 1);
+  }
+  close(ping[1]);
+  wait(0);
+}
+
+void parallel(int n) {
+  uint64 all;
+  int i, nhart = 0, gate[2];
+  char c;
+
+  if (sched_getaffinity(0, &all) < 0 || pipe(gate) < 0) {
+    fprintf(2, "bench: setup failed\n");
+    exit(1);
+  }
+  for (i = 0; i < NCPU; i++) {
+    if ((all & (1UL << i)) == 0) continue;
+    nhart++;
+    if (fork() == 0) {
+      sched_setaffinity(0, 1UL << i);
+      // start together, when the write end closes.
+      close(gate[1]);
+      read(gate[0], &c, 1);
+      null(n);
+      exit(0);
+    }
+  }
+  close(gate[1]);
+  while (nhart-- > 0) wait(0);
+}
+
+struct {
+  char *name;
+  void (*fn)(int);
+} tests[] = {
+    {"null", null},
+    {"pingpong", pingpong},
+    {"parallel", parallel},
+};
+
+int main(int argc, char *argv[]) {
+  int i, n = 100000;
+  uint64 t0, t1;
+
+  if (argc >= 3) n = atoi(argv[2]);
+  for (i = 0; argc >= 2 && i < sizeof(tests) / sizeof(tests[0]); i++)
+    if (strcmp(argv[1], tests[i].name) == 0) break;
+  if (argc < 2 || i == sizeof(tests) / sizeof(tests[0]) || n < 1) {
+    fprintf(2, "usage: bench null|pingpong|parallel [n]\n");
+    exit(1);
+  }
+
+  t0 = rdtime();
+  tests[i].fn(n);
+  t1 = rdtime();
+  printf("%s: %d ns\n", argv[1], (int)((t1 - t0) * (1000000000 / TIMEFREQ) / n));
+  exit(0);
+}
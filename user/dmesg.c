@@ -0,0 +1,17 @@
+// dmesg: print the kernel's recent messages.
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+char buf[16384];  // as big as the kernel's log
+
+int main(void) {
+  int n;
+
+  if ((n = dmesg(buf, sizeof(buf))) < 0) {
+    fprintf(2, "dmesg: failed\n");
+    exit(1);
+  }
+  write(1, buf, n);
+  exit(0);
+}
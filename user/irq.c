@@ -0,0 +1,55 @@
+// irq: show how many interrupts each hart has claimed, per IRQ.
+// irq n mask: deliver IRQ n only to the harts in mask; 0 restores
+// the default (the disk IRQ follows the submitting hart, the
+// others go to every hart).
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/memlayout.h"
+#include "user/user.h"
+
+char *name(int irq) {
+  if (irq == 0) return "none";
+  if (irq == UART0_IRQ) return "uart";
+  if (irq == VIRTIO0_IRQ) return "virtio";
+  return "";
+}
+
+int main(int argc, char *argv[]) {
+  uint counts[NCPU];
+  int irq, hart, ncpu;
+
+  if (argc == 3) {
+    if (irqaffinity(atoi(argv[1]), atoi(argv[2])) < 0) {
+      fprintf(2, "irq: cannot set affinity of irq %s to %s\n", argv[1], argv[2]);
+      exit(1);
+    }
+    exit(0);
+  }
+  if (argc != 1) {
+    fprintf(2, "usage: irq [irq mask]\n");
+    exit(1);
+  }
+
+  // harts that never claimed anything are left out.
+  ncpu = 1;
+  for (irq = 0; irq < NIRQ; irq++) {
+    irqstat(irq, counts);
+    for (hart = ncpu; hart < NCPU; hart++)
+      if (counts[hart]) ncpu = hart + 1;
+  }
+
+  printf("irq\t");
+  for (hart = 0; hart < ncpu; hart++) printf("hart%d\t", hart);
+  printf("\n");
+  for (irq = 0; irq < NIRQ; irq++) {
+    uint total = 0;
+    irqstat(irq, counts);
+    for (hart = 0; hart < ncpu; hart++) total += counts[hart];
+    if (total == 0) continue;
+    printf("%d\t", irq);
+    for (hart = 0; hart < ncpu; hart++) printf("%d\t", counts[hart]);
+    printf("%s\n", name(irq));
+  }
+  exit(0);
+}
@@ -1,8 +1,12 @@
 // Shell.
 
 #include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/fs.h"
 #include "user/user.h"
 #include "kernel/fcntl.h"
+#include "kernel/spawn.h"
 
 // Parsed command representation
 #define EXEC 1
@@ -10,6 +14,7 @@
 #define PIPE 3
 #define LIST 4
 #define BACK 5
+#define BLOCK 6  // ( ... ), run in a subshell
 
 #define MAXARGS 10
 
@@ -49,9 +54,17 @@ struct backcmd {
   struct cmd *cmd;
 };
 
+struct blockcmd {
+  int type;
+  struct cmd *cmd;
+};
+
 int fork1(void);  // Fork but panics on failure.
 void panic(char *);
+void syntax(char *);
 struct cmd *parsecmd(char *);
+void freecmd(struct cmd *);
+char *lookup(char *);
 
 // Execute cmd.  Never returns.
 void runcmd(struct cmd *cmd) {
@@ -71,7 +84,7 @@ void runcmd(struct cmd *cmd) {
     case EXEC:
       ecmd = (struct execcmd *)cmd;
       if (ecmd->argv[0] == 0) exit(1);
-      exec(ecmd->argv[0], ecmd->argv);
+      exec(lookup(ecmd->argv[0]), ecmd->argv);
       fprintf(2, "exec %s failed\n", ecmd->argv[0]);
       break;
 
@@ -119,10 +132,355 @@ void runcmd(struct cmd *cmd) {
       bcmd = (struct backcmd *)cmd;
       if (fork1() == 0) runcmd(bcmd->cmd);
       break;
+
+    case BLOCK:
+      runcmd(((struct blockcmd *)cmd)->cmd);
+      break;
   }
   exit(0);
 }
 
+// Command hash: where each command name was last found.
+// xv6 has no PATH; a name without a '/' is looked for in
+// the current directory and then in "/", where mkfs puts
+// the programs. Remembering the answer saves the stat()s
+// on every later run. cd empties the table.
+#define NHASH 16
+
+struct {
+  char name[DIRSIZ + 1];
+  char path[DIRSIZ + 2];
+} hash[NHASH];
+
+int hashname(char *name) {
+  uint h = 0;
+
+  while (*name) h = h * 31 + *name++;
+  return h % NHASH;
+}
+
+// Return the path to exec for command name.
+char *lookup(char *name) {
+  struct stat st;
+  char path[DIRSIZ + 2];
+  int h;
+
+  if (strchr(name, '/') || strlen(name) > DIRSIZ) return name;
+  h = hashname(name);
+  if (strcmp(hash[h].name, name) == 0) return hash[h].path;
+
+  strcpy(path, name);
+  if (stat(path, &st) < 0) {
+    path[0] = '/';
+    strcpy(path + 1, name);
+    if (stat(path, &st) < 0) return name;
+  }
+  strcpy(hash[h].name, name);
+  strcpy(hash[h].path, path);
+  return hash[h].path;
+}
+
+// Forget name, e.g. because its exec failed.
+void unhash(char *name) {
+  int h = hashname(name);
+
+  if (strcmp(hash[h].name, name) == 0) hash[h].name[0] = 0;
+}
+
+// Children the shell has started and not yet reaped.
+// Job 0 is the foreground command line; each background
+// ("&") command is a job numbered from 1.
+#define NCHILD 64
+
+struct {
+  int pid;
+  int job;
+} children[NCHILD];
+int nextjob = 1;
+
+void addchild(int pid, int job) {
+  for (int i = 0; i < NCHILD; i++) {
+    if (children[i].pid == 0) {
+      children[i].pid = pid;
+      children[i].job = job;
+      return;
+    }
+  }
+  // untracked; it is still reaped by a later wait().
+}
+
+// Return 1 if any process of job is still running.
+int running(int job) {
+  for (int i = 0; i < NCHILD; i++)
+    if (children[i].pid && children[i].job == job) return 1;
+  return 0;
+}
+
+// Reap one child. Returns -1 if there are none left.
+int reap(void) {
+  int i, pid;
+
+  if ((pid = wait(0)) < 0) {
+    for (i = 0; i < NCHILD; i++) children[i].pid = 0;
+    return -1;
+  }
+  for (i = 0; i < NCHILD; i++)
+    if (children[i].pid == pid) children[i].pid = 0;
+  return pid;
+}
+
+void waitjob(int job) {
+  while (running(job) && reap() >= 0)
+    ;
+}
+
+// Builtin commands run in the shell process itself.
+// cd must; the rest are common enough in scripts that a
+// fork and exec for each is most of their cost.
+char cwd[MAXPATH] = "/";  // for pwd; the kernel keeps no name
+
+// Apply a successful chdir(path) to cwd.
+void setcwd(char *path) {
+  char *p, *e;
+  int n;
+
+  if (path[0] == '/') strcpy(cwd, "/");
+  for (p = path; *p; p = e) {
+    while (*p == '/') p++;
+    for (e = p; *e && *e != '/'; e++)
+      ;
+    n = e - p;
+    if (n == 0 || (n == 1 && p[0] == '.')) continue;
+    if (n == 2 && p[0] == '.' && p[1] == '.') {
+      char *slash = cwd + strlen(cwd);
+      while (slash > cwd && *slash != '/') slash--;
+      slash[slash == cwd] = 0;
+      continue;
+    }
+    int len = strlen(cwd);
+    if (len + 1 + n >= MAXPATH) continue;
+    if (cwd[len - 1] != '/') cwd[len++] = '/';
+    memmove(cwd + len, p, n);
+    cwd[len + n] = 0;
+  }
+}
+
+void bcd(char **argv) {
+  char *dir = argv[1] ? argv[1] : "/";
+
+  if (chdir(dir) < 0) {
+    fprintf(2, "cannot cd %s\n", dir);
+    return;
+  }
+  setcwd(dir);
+  memset(hash, 0, sizeof(hash));
+}
+
+void bpwd(char **argv) { printf("%s\n", cwd); }
+
+void becho(char **argv) {
+  char line[100];  // as long as any command line
+  int i, n = 0;
+
+  for (i = 1; argv[i]; i++) {
+    int len = strlen(argv[i]);
+    if (n + len + 1 > sizeof(line)) len = sizeof(line) - n - 1;
+    memmove(line + n, argv[i], len);
+    n += len;
+    line[n++] = argv[i + 1] ? ' ' : '\n';
+  }
+  if (n == 0) line[n++] = '\n';
+  write(1, line, n);
+}
+
+// sleep ticks. the lab's own sleep program still runs when
+// named by a path, e.g. /sleep, since builtins match only
+// the bare name.
+void bsleep(char **argv) {
+  if (argv[1] == 0 || argv[2] != 0) {
+    fprintf(2, "usage: sleep ticks\n");
+    return;
+  }
+  sleep(atoi(argv[1]));
+}
+
+// kill pid... or kill %job
+void bkill(char **argv) {
+  int i, j;
+
+  if (argv[1] == 0) {
+    fprintf(2, "usage: kill pid...\n");
+    return;
+  }
+  for (i = 1; argv[i]; i++) {
+    if (argv[i][0] != '%') {
+      kill(atoi(argv[i]));
+      continue;
+    }
+    for (j = 0; j < NCHILD; j++)
+      if (children[j].pid && children[j].job == atoi(argv[i] + 1)) kill(children[j].pid);
+  }
+}
+
+void bjobs(char **argv) {
+  for (int i = 0; i < NCHILD; i++)
+    if (children[i].pid && children[i].job) printf("[%d] %d\n", children[i].job, children[i].pid);
+}
+
+// wait [%job]: wait for one background job, or all of them.
+void bwait(char **argv) {
+  if (argv[1] && argv[1][0] == '%') {
+    waitjob(atoi(argv[1] + 1));
+    return;
+  }
+  while (reap() >= 0)
+    ;
+}
+
+// hash [-r]: list, or with -r empty, the command hash.
+void bhash(char **argv) {
+  for (int i = 0; i < NHASH; i++) {
+    if (hash[i].name[0] == 0) continue;
+    if (argv[1] && strcmp(argv[1], "-r") == 0)
+      hash[i].name[0] = 0;
+    else
+      printf("%s\t%s\n", hash[i].name, hash[i].path);
+  }
+}
+
+struct {
+  char *name;
+  void (*fn)(char **);
+} builtins[] = {
+    {"cd", bcd},     {"pwd", bpwd},   {"echo", becho}, {"sleep", bsleep},
+    {"kill", bkill}, {"jobs", bjobs}, {"wait", bwait}, {"hash", bhash},
+};
+
+// Run ecmd in the shell if it is a builtin, with the
+// redirections in act[0..nact) applied to the shell's own
+// descriptors until it is done. Returns 0, having done
+// nothing, if ecmd is not a builtin or act is not only
+// redirections, e.g. because ecmd is part of a pipeline.
+int runbuiltin(struct execcmd *ecmd, struct spawnact *act, int nact) {
+  int i, b, fd, saved[MAXSPAWNACT];
+
+  for (b = 0; b < sizeof(builtins) / sizeof(builtins[0]); b++)
+    if (strcmp(ecmd->argv[0], builtins[b].name) == 0) break;
+  if (b == sizeof(builtins) / sizeof(builtins[0])) return 0;
+  for (i = 0; i < nact; i++)
+    if (act[i].op != SPAWN_OPEN) return 0;
+
+  for (i = 0; i < nact; i++) {
+    saved[i] = dup(act[i].fd);
+    close(act[i].fd);
+    if ((fd = open(act[i].path, act[i].arg)) != act[i].fd) {
+      if (fd >= 0) close(fd);
+      fprintf(2, "open %s failed\n", act[i].path);
+      i++;
+      goto restore;
+    }
+  }
+  builtins[b].fn(ecmd->argv);
+
+restore:
+  while (--i >= 0) {
+    close(act[i].fd);
+    if (saved[i] >= 0) {
+      dup(saved[i]);
+      close(saved[i]);
+    }
+  }
+  return 1;
+}
+
+// Apply spawn file actions by hand, in a forked child.
+void runacts(struct spawnact *act, int nact) {
+  for (int i = 0; i < nact; i++) {
+    close(act[i].fd);
+    if (act[i].op == SPAWN_DUP) {
+      dup(act[i].arg);
+    } else if (act[i].op == SPAWN_OPEN && open(act[i].path, act[i].arg) < 0) {
+      fprintf(2, "open %s failed\n", act[i].path);
+      exit(1);
+    }
+  }
+}
+
+// Start cmd as part of job, with the file actions
+// act[0..nact) applied first. Foreground builtins run in
+// the shell. Simple commands, redirections and pipelines
+// are created with spawn(), which skips copying the shell's
+// memory. Anything else, or a spawn() that fails, goes
+// through fork1() and runcmd(), which also reports the
+// error as before.
+void startcmd(struct cmd *cmd, struct spawnact *act, int nact, int job) {
+  int pid, p[2];
+  struct execcmd *ecmd;
+  struct pipecmd *pcmd;
+  struct redircmd *rcmd;
+
+  switch (cmd->type) {
+    case EXEC:
+      ecmd = (struct execcmd *)cmd;
+      if (ecmd->argv[0] == 0) return;
+      if (job == 0 && runbuiltin(ecmd, act, nact)) return;
+      if ((pid = spawn(lookup(ecmd->argv[0]), ecmd->argv, act, nact)) >= 0) {
+        addchild(pid, job);
+        return;
+      }
+      unhash(ecmd->argv[0]);
+      break;
+
+    case REDIR:
+      if (nact + 1 > MAXSPAWNACT) break;
+      rcmd = (struct redircmd *)cmd;
+      act[nact] = (struct spawnact){SPAWN_OPEN, rcmd->fd, rcmd->mode, rcmd->file};
+      startcmd(rcmd->cmd, act, nact + 1, job);
+      return;
+
+    case PIPE:
+      if (nact + 3 > MAXSPAWNACT) break;
+      pcmd = (struct pipecmd *)cmd;
+      if (pipe(p) < 0) panic("pipe");
+      act[nact] = (struct spawnact){SPAWN_DUP, 1, p[1]};
+      act[nact + 1] = (struct spawnact){SPAWN_CLOSE, p[0]};
+      act[nact + 2] = (struct spawnact){SPAWN_CLOSE, p[1]};
+      startcmd(pcmd->left, act, nact + 3, job);
+      act[nact] = (struct spawnact){SPAWN_DUP, 0, p[0]};
+      startcmd(pcmd->right, act, nact + 3, job);
+      close(p[0]);
+      close(p[1]);
+      return;
+  }
+
+  if ((pid = fork1()) == 0) {
+    runacts(act, nact);
+    runcmd(cmd);
+  }
+  addchild(pid, job);
+}
+
+// Run a parsed command line: the parts of a list in turn,
+// background commands as new jobs, and anything else in the
+// foreground, waiting for it to finish.
+void runline(struct cmd *cmd, struct spawnact *act) {
+  switch (cmd->type) {
+    case LIST:
+      runline(((struct listcmd *)cmd)->left, act);
+      runline(((struct listcmd *)cmd)->right, act);
+      break;
+
+    case BACK:
+      startcmd(((struct backcmd *)cmd)->cmd, act, 0, nextjob++);
+      break;
+
+    default:
+      startcmd(cmd, act, 0, 0);
+      waitjob(0);
+      break;
+  }
+}
+
 int getcmd(char *buf, int nbuf) {
   fprintf(2, "$ ");
   memset(buf, 0, nbuf);
@@ -134,6 +492,8 @@ int getcmd(char *buf, int nbuf) {
 
 int main(void) {
   static char buf[100];
+  struct spawnact act[MAXSPAWNACT];
+  struct cmd *cmd;
   int fd;
 
   // Ensure that three file descriptors are open.
@@ -146,14 +506,9 @@ int main(void) {
 
   // Read and run input commands.
   while (getcmd(buf, sizeof(buf)) >= 0) {
-    if (buf[0] == 'c' && buf[1] == 'd' && buf[2] == ' ') {
-      // Chdir must be called by the parent, not the child.
-      buf[strlen(buf) - 1] = 0;  // chop \n
-      if (chdir(buf + 3) < 0) fprintf(2, "cannot cd %s\n", buf + 3);
-      continue;
-    }
-    if (fork1() == 0) runcmd(parsecmd(buf));
-    wait(0);
+    if ((cmd = parsecmd(buf)) == 0) continue;
+    runline(cmd, act);
+    freecmd(cmd);
   }
   exit(0);
 }
@@ -163,6 +518,16 @@ void panic(char *s) {
   exit(1);
 }
 
+// The shell parses commands itself rather than in a child,
+// so a syntax error must not exit. Report the first one and
+// let parsecmd() return 0.
+int parseerr;
+
+void syntax(char *s) {
+  if (!parseerr) fprintf(2, "%s\n", s);
+  parseerr = 1;
+}
+
 int fork1(void) {
   int pid;
 
@@ -228,6 +593,42 @@ struct cmd *backcmd(struct cmd *subcmd) {
   cmd->cmd = subcmd;
   return (struct cmd *)cmd;
 }
+
+struct cmd *blockcmd(struct cmd *subcmd) {
+  struct blockcmd *cmd;
+
+  cmd = malloc(sizeof(*cmd));
+  memset(cmd, 0, sizeof(*cmd));
+  cmd->type = BLOCK;
+  cmd->cmd = subcmd;
+  return (struct cmd *)cmd;
+}
+
+// Free a command tree made by the constructors above.
+void freecmd(struct cmd *cmd) {
+  if (cmd == 0) return;
+
+  switch (cmd->type) {
+    case REDIR:
+      freecmd(((struct redircmd *)cmd)->cmd);
+      break;
+    case PIPE:
+      freecmd(((struct pipecmd *)cmd)->left);
+      freecmd(((struct pipecmd *)cmd)->right);
+      break;
+    case LIST:
+      freecmd(((struct listcmd *)cmd)->left);
+      freecmd(((struct listcmd *)cmd)->right);
+      break;
+    case BACK:
+      freecmd(((struct backcmd *)cmd)->cmd);
+      break;
+    case BLOCK:
+      freecmd(((struct blockcmd *)cmd)->cmd);
+      break;
+  }
+  free(cmd);
+}
 // PAGEBREAK!
 //  Parsing
 
@@ -290,12 +691,17 @@ struct cmd *parsecmd(char *s) {
   char *es;
   struct cmd *cmd;
 
+  parseerr = 0;
   es = s + strlen(s);
   cmd = parseline(&s, es);
   peek(&s, es, "");
-  if (s != es) {
+  if (s != es && !parseerr) {
     fprintf(2, "leftovers: %s\n", s);
-    panic("syntax");
+    syntax("syntax");
+  }
+  if (parseerr) {
+    freecmd(cmd);
+    return 0;
   }
   nulterminate(cmd);
   return cmd;
@@ -305,11 +711,11 @@ struct cmd *parseline(char **ps, char *es) {
   struct cmd *cmd;
 
   cmd = parsepipe(ps, es);
-  while (peek(ps, es, "&")) {
+  while (!parseerr && peek(ps, es, "&")) {
     gettoken(ps, es, 0, 0);
     cmd = backcmd(cmd);
   }
-  if (peek(ps, es, ";")) {
+  if (!parseerr && peek(ps, es, ";")) {
     gettoken(ps, es, 0, 0);
     cmd = listcmd(cmd, parseline(ps, es));
   }
@@ -320,7 +726,7 @@ struct cmd *parsepipe(char **ps, char *es) {
   struct cmd *cmd;
 
   cmd = parseexec(ps, es);
-  if (peek(ps, es, "|")) {
+  if (!parseerr && peek(ps, es, "|")) {
     gettoken(ps, es, 0, 0);
     cmd = pipecmd(cmd, parsepipe(ps, es));
   }
@@ -331,9 +737,12 @@ struct cmd *parseredirs(struct cmd *cmd, char **ps, char *es) {
   int tok;
   char *q, *eq;
 
-  while (peek(ps, es, "<>")) {
+  while (!parseerr && peek(ps, es, "<>")) {
     tok = gettoken(ps, es, 0, 0);
-    if (gettoken(ps, es, &q, &eq) != 'a') panic("missing file for redirection");
+    if (gettoken(ps, es, &q, &eq) != 'a') {
+      syntax("missing file for redirection");
+      break;
+    }
     switch (tok) {
       case '<':
         cmd = redircmd(cmd, q, eq, O_RDONLY, 0);
@@ -354,8 +763,14 @@ struct cmd *parseblock(char **ps, char *es) {
 
   if (!peek(ps, es, "(")) panic("parseblock");
   gettoken(ps, es, 0, 0);
-  cmd = parseline(ps, es);
-  if (!peek(ps, es, ")")) panic("syntax - missing )");
+  // the block runs in a child, so cd and lists inside it
+  // don't touch the shell itself.
+  cmd = blockcmd(parseline(ps, es));
+  if (parseerr) return cmd;
+  if (!peek(ps, es, ")")) {
+    syntax("syntax - missing )");
+    return cmd;
+  }
   gettoken(ps, es, 0, 0);
   cmd = parseredirs(cmd, ps, es);
   return cmd;
@@ -374,13 +789,20 @@ struct cmd *parseexec(char **ps, char *es) {
 
   argc = 0;
   ret = parseredirs(ret, ps, es);
-  while (!peek(ps, es, "|)&;")) {
+  while (!parseerr && !peek(ps, es, "|)&;")) {
     if ((tok = gettoken(ps, es, &q, &eq)) == 0) break;
-    if (tok != 'a') panic("syntax");
+    if (tok != 'a') {
+      syntax("syntax");
+      break;
+    }
     cmd->argv[argc] = q;
     cmd->eargv[argc] = eq;
     argc++;
-    if (argc >= MAXARGS) panic("too many args");
+    if (argc >= MAXARGS) {
+      syntax("too many args");
+      argc--;
+      break;
+    }
     ret = parseredirs(ret, ps, es);
   }
   cmd->argv[argc] = 0;
@@ -427,6 +849,10 @@ struct cmd *nulterminate(struct cmd *cmd) {
       bcmd = (struct backcmd *)cmd;
       nulterminate(bcmd->cmd);
       break;
+
+    case BLOCK:
+      nulterminate(((struct blockcmd *)cmd)->cmd);
+      break;
   }
   return cmd;
 }
@@ -0,0 +1,76 @@
+// taskset mask command [args...]
+// taskset -p pid [mask]
+// taskset -i mask
+//
+// Run command pinned to the harts in mask (bit i for hart i,
+// in hex with a 0x prefix or decimal), show or set the harts
+// process pid may run on, or leave the harts in mask to
+// pinned processes only.
+
+#include "kernel/types.h"
+#include "user/user.h"
+
+void usage(void) {
+  fprintf(2, "usage: taskset mask command [args...] | -p pid [mask] | -i mask\n");
+  exit(1);
+}
+
+uint64 mask(char *s) {
+  uint64 m = 0;
+  int d;
+
+  if (s[0] == '0' && s[1] == 'x') {
+    for (s += 2; *s; s++) {
+      if (*s >= '0' && *s <= '9')
+        d = *s - '0';
+      else if (*s >= 'a' && *s <= 'f')
+        d = *s - 'a' + 10;
+      else
+        usage();
+      m = m * 16 + d;
+    }
+    return m;
+  }
+  for (; *s; s++) {
+    if (*s < '0' || *s > '9') usage();
+    m = m * 10 + *s - '0';
+  }
+  return m;
+}
+
+int main(int argc, char *argv[]) {
+  uint64 m;
+  int pid;
+
+  if (argc < 3) usage();
+  if (strcmp(argv[1], "-i") == 0) {
+    if (argc != 3) usage();
+    if (sched_isolate(mask(argv[2])) < 0) {
+      fprintf(2, "taskset: cannot isolate every hart\n");
+      exit(1);
+    }
+    exit(0);
+  }
+  if (strcmp(argv[1], "-p") == 0) {
+    if (argc > 4) usage();
+    pid = atoi(argv[2]);
+    if (argc == 4 && sched_setaffinity(pid, mask(argv[3])) < 0) {
+      fprintf(2, "taskset: cannot pin %d\n", pid);
+      exit(1);
+    }
+    if (sched_getaffinity(pid, &m) < 0) {
+      fprintf(2, "taskset: no process %d\n", pid);
+      exit(1);
+    }
+    printf("%d: 0x%x\n", pid, (int)m);
+    exit(0);
+  }
+
+  if (sched_setaffinity(0, mask(argv[1])) < 0) {
+    fprintf(2, "taskset: no such harts\n");
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "taskset: exec %s failed\n", argv[2]);
+  exit(1);
+}
@@ -0,0 +1,43 @@
+// time command [args...]
+//
+// Run command and report the time and other resources it and
+// its descendants used.
+
+#include "kernel/types.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+// milliseconds in n time CSR ticks.
+int ms(uint64 n) { return n / (TIMEFREQ / 1000); }
+
+int main(int argc, char *argv[]) {
+  struct rusage before, after;
+  int pid, status, start;
+
+  if (argc < 2) {
+    fprintf(2, "usage: time command [args...]\n");
+    exit(1);
+  }
+
+  getrusage(RUSAGE_CHILDREN, &before);
+  start = uptime();
+  if ((pid = fork()) < 0) {
+    fprintf(2, "time: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    exec(argv[1], argv + 1);
+    fprintf(2, "time: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  wait(&status);
+  getrusage(RUSAGE_CHILDREN, &after);
+
+  // a clock tick is 1/10th second.
+  fprintf(2, "real %dms user %dms sys %dms\n", (uptime() - start) * 100, ms(after.utime - before.utime),
+          ms(after.stime - before.stime));
+  fprintf(2, "%d+%d csw %d faults %d+%d blocks %d syscalls %d pages maxrss\n", after.nvcsw - before.nvcsw,
+          after.nivcsw - before.nivcsw, after.nfault - before.nfault, after.inblock - before.inblock,
+          after.oublock - before.oublock, after.nsyscall - before.nsyscall, after.maxrss);
+  exit(status);
+}
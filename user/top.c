@@ -0,0 +1,136 @@
+// top [-n count] [-d ticks]
+//
+// Show system statistics every ticks clock ticks (default 10,
+// a second), count times (default: until killed). Rates are
+// over the last interval. Each screen is formatted into a
+// buffer and written with a single write().
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stats.h"
+#include "user/user.h"
+
+char out[2048];
+int nout;
+
+void put(char *s) {
+  while (*s && nout < sizeof(out)) out[nout++] = *s++;
+}
+
+void putn(uint n) {
+  char buf[12];
+  int i = sizeof(buf) - 1;
+
+  buf[i] = 0;
+  do {
+    buf[--i] = '0' + n % 10;
+  } while ((n /= 10) != 0);
+  put(buf + i);
+}
+
+void show(struct stats *old, struct stats *st) {
+  uint64 dt = st->time - old->time;
+  uint look = st->bhit + st->bmiss - old->bhit - old->bmiss;
+
+  nout = 0;
+  put("\033[H\033[J");
+  put("up ");
+  putn(st->ticks / 10);
+  put("s  free ");
+  putn(st->freepages);
+  put(" pages  procs ");
+  putn(st->nproc);
+  put(" (");
+  putn(st->nrunnable);
+  put(" runnable, ");
+  putn(st->nsleeping);
+  put(" sleeping)  real-time ");
+  putn(st->rtutil / 10);
+  put("%\n");
+  put("mem ");
+  putn(st->rsspages);
+  put(" user pages, ");
+  putn(st->ptpages);
+  put(" page-table pages\nfree blocks");
+  for (int k = 0; k <= KMAXORDER; k++) {
+    put(" ");
+    putn(st->freeblocks[k]);
+  }
+  put(" (1 to ");
+  putn(1 << KMAXORDER);
+  put(" pages)\n");
+
+  put("bcache ");
+  putn(look ? (st->bhit - old->bhit) * 100 / look : 100);
+  put("% hit  inodes ");
+  putn(st->iused);
+  put("/");
+  putn(NINODE);
+  put("  commits ");
+  putn(st->ncommit - old->ncommit);
+  put("  disk ");
+  putn(st->nread - old->nread);
+  put("r ");
+  putn(st->nwrite - old->nwrite);
+  put("w\n\ncpu\tbusy\tpid\tcsw\tintr\tsoft\twork\n");
+
+  for (int i = 0; i < NCPU; i++) {
+    struct cpustat *c = &st->cpu[i], *o = &old->cpu[i];
+    if (c->nswitch == 0 && c->idle == 0) continue;  // not running
+    putn(i);
+    put("\t");
+    putn(dt ? 100 - (c->idle - o->idle) * 100 / dt : 0);
+    put("%\t");
+    putn(c->pid);
+    put("\t");
+    putn(c->nswitch - o->nswitch);
+    put("\t");
+    putn(c->nintr - o->nintr);
+    put("\t");
+    putn(c->nsoftirq - o->nsoftirq);
+    put("\t");
+    putn(c->nwork - o->nwork);
+    put("\n");
+  }
+
+  put("\ngroup\ttickets\tprocs\tcpu\n");
+  for (int i = 0; i < NGROUP; i++) {
+    struct groupstat *g = &st->group[i];
+    if (g->tickets == 0) continue;
+    putn(i);
+    put("\t");
+    putn(g->tickets);
+    put("\t");
+    putn(g->nproc);
+    put("\t");
+    putn(dt ? (g->runtime - old->group[i].runtime) * 100 / dt : 0);
+    put("%\n");
+  }
+  write(1, out, nout);
+}
+
+int main(int argc, char *argv[]) {
+  static struct stats st[2];
+  int i, count = -1, delay = 10;
+
+  for (i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "-n") == 0)
+      count = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-d") == 0)
+      delay = atoi(argv[i + 1]);
+    else
+      break;
+  }
+  if (i != argc || delay < 1) {
+    fprintf(2, "usage: top [-n count] [-d ticks]\n");
+    exit(1);
+  }
+
+  stats(&st[0]);
+  for (i = 1; count < 0 || i <= count; i++) {
+    sleep(delay);
+    stats(&st[i % 2]);
+    show(&st[(i + 1) % 2], &st[i % 2]);
+  }
+  exit(0);
+}
@@ -1,5 +1,9 @@
 struct stat;
 struct rtcdate;
+struct spawnact;
+struct rusage;
+struct rlimit;
+struct stats;
 
 // system calls
 int fork(void);
@@ -23,6 +27,21 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int spawn(const char*, char**, struct spawnact*, int);
+int irqaffinity(int, uint);
+int irqstat(int, uint*);
+int getrusage(int, struct rusage*);
+int stats(struct stats*);
+int dmesg(char*, int);
+int getrlimit(int, struct rlimit*);
+int setrlimit(int, struct rlimit*);
+int sched_setaffinity(int, uint64);
+int sched_getaffinity(int, uint64*);
+int sched_isolate(uint64);
+int sched_settickets(int, int);
+int sched_setgroup(int, int);
+int sched_setshare(int, int);
+int sched_setrt(int, int, int);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,9 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/spawn.h"
+#include "kernel/rusage.h"
+#include "kernel/stats.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -641,6 +644,740 @@ void exectest(char *s) {
   }
 }
 
+// spawn() with a redirection and a pipe, and spawn()s that must
+// fail without leaving a child behind.
+void spawntest(char *s) {
+  int fd, xstatus, pid, fds[2];
+  char *echoargv[] = {"echo", "OK", 0};
+  char *catargv[] = {"cat", 0};
+  char buf[3];
+  struct spawnact act[3];
+
+  unlink("spawn-ok");
+  if (pipe(fds) < 0) {
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  act[0] = (struct spawnact){SPAWN_DUP, 1, fds[1]};
+  act[1] = (struct spawnact){SPAWN_CLOSE, fds[0]};
+  act[2] = (struct spawnact){SPAWN_CLOSE, fds[1]};
+  if ((pid = spawn("echo", echoargv, act, 3)) < 0) {
+    printf("%s: spawn echo failed\n", s);
+    exit(1);
+  }
+  act[0] = (struct spawnact){SPAWN_DUP, 0, fds[0]};
+  act[1] = (struct spawnact){SPAWN_OPEN, 1, O_CREATE | O_WRONLY, "spawn-ok"};
+  act[2] = (struct spawnact){SPAWN_CLOSE, fds[0]};
+  if (spawn("cat", catargv, act, 3) < 0) {
+    printf("%s: spawn cat failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  for (int i = 0; i < 2; i++) {
+    if (wait(&xstatus) < 0 || xstatus != 0) {
+      printf("%s: wait failed\n", s);
+      exit(1);
+    }
+  }
+
+  fd = open("spawn-ok", O_RDONLY);
+  if (fd < 0 || read(fd, buf, 2) != 2) {
+    printf("%s: read failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("spawn-ok");
+  if (buf[0] != 'O' || buf[1] != 'K') {
+    printf("%s: wrong output\n", s);
+    exit(1);
+  }
+
+  act[0] = (struct spawnact){SPAWN_OPEN, 0, O_RDONLY, "nonexistent"};
+  if (spawn("echo", echoargv, act, 1) >= 0 || spawn("nonexistent", echoargv, 0, 0) >= 0) {
+    printf("%s: spawn should have failed\n", s);
+    exit(1);
+  }
+  act[0] = (struct spawnact){SPAWN_DUP, 0, NOFILE};
+  if (spawn("echo", echoargv, act, 1) >= 0) {
+    printf("%s: spawn with bad fd should have failed\n", s);
+    exit(1);
+  }
+  if (wait(0) != -1) {
+    printf("%s: failed spawn left a child\n", s);
+    exit(1);
+  }
+  exit(0);
+}
+
+// run wc, with file as its argument or, if file is 0, with
+// buf[0..n) on its standard input. return its output.
+char *runwc(char *s, char *file, int n, char *out, int nout) {
+  int pid, cc, tot, in[2], res[2];
+  char *argv[] = {"wc", file, 0};
+
+  if (pipe(in) < 0 || pipe(res) < 0) {
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  if ((pid = fork()) < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if (pid == 0) {
+    close(0);
+    dup(in[0]);
+    close(1);
+    dup(res[1]);
+    close(in[0]);
+    close(in[1]);
+    close(res[0]);
+    close(res[1]);
+    exec("wc", argv);
+    printf("%s: exec wc failed\n", s);
+    exit(1);
+  }
+  close(in[0]);
+  close(res[1]);
+  if (file == 0 && write(in[1], buf, n) != n) {
+    printf("%s: write to wc failed\n", s);
+    exit(1);
+  }
+  close(in[1]);
+  for (tot = 0; tot < nout - 1 && (cc = read(res[0], out + tot, nout - 1 - tot)) > 0; tot += cc)
+    ;
+  out[tot] = 0;
+  close(res[0]);
+  wait(0);
+  return out;
+}
+
+// wc counts a word at a time; check it against the
+// byte-at-a-time loop it replaced, over text with runs of
+// every kind of whitespace and words straddling 8-byte and
+// read() boundaries.
+void wctest(char *s) {
+  static char alpha[] = "ab\n x\t\v\r\f\377\0";
+  char out[64];
+  int got[3];
+  uint seed = 1;
+  int i, fd, l, w, c, inword, n = BUFSZ - 3;
+
+  for (i = 0; i < n; i++) {
+    seed = seed * 1664525 + 1013904223;
+    buf[i] = alpha[(seed >> 16) % (sizeof(alpha) - 1)];
+  }
+  l = w = c = inword = 0;
+  for (i = 0; i < n; i++) {
+    c++;
+    if (buf[i] == '\n') l++;
+    if (strchr(" \r\t\n\v", buf[i]))
+      inword = 0;
+    else if (!inword) {
+      w++;
+      inword = 1;
+    }
+  }
+
+  fd = open("wc-in", O_CREATE | O_WRONLY);
+  if (fd < 0 || write(fd, buf, n) != n) {
+    printf("%s: write wc-in failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // the file path reads whole buffers; the pipe path gets
+  // short reads, which leave a tail to count a byte at a time.
+  for (int run = 0; run < 2; run++) {
+    char *p = runwc(s, run == 0 ? "wc-in" : 0, n, out, sizeof(out));
+    for (i = 0; i < 3; i++) {
+      got[i] = atoi(p);
+      while (*p >= '0' && *p <= '9') p++;
+      if (*p++ != ' ') break;
+    }
+    if (i < 3 || got[0] != l || got[1] != w || got[2] != c) {
+      printf("%s: wc said %s, want %d %d %d\n", s, out, l, w, c);
+      exit(1);
+    }
+  }
+  unlink("wc-in");
+}
+
+// pin the disk interrupt to hart 0 and check that no other
+// hart claims it while the disk is busy.
+void irqtest(char *s) {
+  uint before[NCPU], after[NCPU];
+  int fd, i;
+
+  if (irqaffinity(0, 1) >= 0 || irqaffinity(VIRTIO0_IRQ, 1u << 31) >= 0) {
+    printf("%s: bad irqaffinity succeeded\n", s);
+    exit(1);
+  }
+  if (irqaffinity(VIRTIO0_IRQ, 1) < 0) {
+    printf("%s: irqaffinity failed\n", s);
+    exit(1);
+  }
+  irqstat(VIRTIO0_IRQ, before);
+  fd = open("irq-file", O_CREATE | O_WRONLY);
+  for (i = 0; i < 20; i++) {
+    if (write(fd, buf, BSIZE) != BSIZE) {
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("irq-file");
+  irqstat(VIRTIO0_IRQ, after);
+  irqaffinity(VIRTIO0_IRQ, 0);
+
+  if (after[0] == before[0]) {
+    printf("%s: hart 0 took no disk interrupts\n", s);
+    exit(1);
+  }
+  for (i = 1; i < NCPU; i++) {
+    if (after[i] != before[i]) {
+      printf("%s: hart %d took a disk interrupt\n", s, i);
+      exit(1);
+    }
+  }
+}
+
+// a reaped child's system calls and disk writes show up
+// in the parent's RUSAGE_CHILDREN.
+void rusagetest(char *s) {
+  struct rusage before, after, self;
+  int i, fd, pid, xstatus;
+
+  if (getrusage(RUSAGE_CHILDREN, &before) < 0 || getrusage(2, &after) >= 0) {
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if (pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if (pid == 0) {
+    for (i = 0; i < 100; i++) getpid();
+    fd = open("rusage-file", O_CREATE | O_WRONLY);
+    write(fd, "x", 1);
+    close(fd);
+    unlink("rusage-file");
+    exit(0);
+  }
+  wait(&xstatus);
+  if (xstatus != 0) exit(xstatus);
+  getrusage(RUSAGE_CHILDREN, &after);
+  if (after.nsyscall - before.nsyscall < 100 || after.oublock == before.oublock) {
+    printf("%s: child's usage not counted\n", s);
+    exit(1);
+  }
+  if (getrusage(RUSAGE_SELF, &self) < 0 || self.nsyscall == 0 || self.stime == 0) {
+    printf("%s: own usage not counted\n", s);
+    exit(1);
+  }
+}
+
+// stats() sees memory being allocated and a log commit.
+void statstest(char *s) {
+  static struct stats before, after;
+  int fd, i;
+  char *a;
+
+  if (stats(&before) < 0) {
+    printf("%s: stats failed\n", s);
+    exit(1);
+  }
+  // sbrk() only reserves the pages; writing takes them.
+  a = sbrk(10 * PGSIZE);
+  for (i = 0; i < 10; i++) a[i * PGSIZE] = 1;
+  fd = open("stats-file", O_CREATE | O_WRONLY);
+  close(fd);
+  unlink("stats-file");
+  stats(&after);
+  if (after.freepages > before.freepages - 10 || after.ncommit == before.ncommit || after.nproc == 0 ||
+      after.time <= before.time) {
+    printf("%s: stats did not change\n", s);
+    exit(1);
+  }
+}
+
+// a kernel message about a faulting child shows up in dmesg().
+void dmesgtest(char *s) {
+  static char log[16384];
+  char want[16];
+  int i, n, pid;
+
+  pid = fork();
+  if (pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if (pid == 0) {
+    *(volatile int *)0xdeadbeef = 1;  // usertrap() prints pid=...
+    exit(0);
+  }
+  wait(0);
+
+  // look for "pid=<pid>\t" or "pid=<pid>\n".
+  strcpy(want, "pid=");
+  for (i = 100000, n = 4; i > 0; i /= 10)
+    if (pid >= i || n > 4 || i == 1) want[n++] = '0' + pid / i % 10;
+  want[n] = 0;
+
+  n = dmesg(log, sizeof(log));
+  for (i = 0; i + strlen(want) < n; i++) {
+    if (memcmp(log + i, want, strlen(want)) == 0 && (log[i + strlen(want)] < '0' || log[i + strlen(want)] > '9'))
+      return;
+  }
+  printf("%s: no %s in dmesg\n", s, want);
+  exit(1);
+}
+
+// which hart is running the caller, per stats().
+int myhart(void) {
+  static struct stats st;
+  int pid = getpid();
+
+  if (stats(&st) < 0) return -1;
+  for (int i = 0; i < NCPU; i++)
+    if (st.cpu[i].pid == pid) return i;
+  return -1;
+}
+
+// a pinned process runs only on its hart, and its children
+// inherit the pin.
+void affinitytest(char *s) {
+  uint64 all, m;
+  int i, hart, pid, xstatus;
+
+  if (sched_getaffinity(0, &all) < 0 || all == 0) {
+    printf("%s: getaffinity failed\n", s);
+    exit(1);
+  }
+  if (sched_setaffinity(0, 0) >= 0) {
+    printf("%s: pinned to no harts\n", s);
+    exit(1);
+  }
+  for (hart = NCPU - 1; (all & (1UL << hart)) == 0; hart--)
+    ;
+  if (sched_setaffinity(0, 1UL << hart) < 0) {
+    printf("%s: setaffinity failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 20; i++) {
+    if (myhart() != hart) {
+      printf("%s: running on hart %d, not %d\n", s, myhart(), hart);
+      exit(1);
+    }
+    if (i % 5 == 0) sleep(1);
+  }
+
+  pid = fork();
+  if (pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if (pid == 0) {
+    if (sched_getaffinity(0, &m) < 0 || m != (1UL << hart) || myhart() != hart) exit(1);
+    exit(0);
+  }
+  wait(&xstatus);
+  if (xstatus != 0) {
+    printf("%s: child not pinned\n", s);
+    exit(1);
+  }
+
+  // every hart cannot be isolated; the pinned one can.
+  if (sched_isolate(all) >= 0) {
+    printf("%s: isolated every hart\n", s);
+    exit(1);
+  }
+  if (all != (1UL << hart)) {
+    if (sched_isolate(1UL << hart) < 0 || sched_getaffinity(0, &m) < 0 || m != (1UL << hart)) {
+      printf("%s: isolate failed\n", s);
+      exit(1);
+    }
+    sched_isolate(0);
+  }
+}
+
+// two groups with equal shares get about equal CPU time on
+// one hart, though one has three processes and the other one.
+void grouptest(char *s) {
+  static struct stats st;
+  int i, t, ga, gb, pids[4], gate[2];
+  uint64 all, a, b;
+  char c;
+
+  if (sched_getaffinity(0, &all) < 0) {
+    printf("%s: getaffinity failed\n", s);
+    exit(1);
+  }
+  for (i = NCPU - 1; (all & (1UL << i)) == 0; i--)
+    ;
+  if (sched_setaffinity(0, 1UL << i) < 0 || pipe(gate) < 0) {
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 4; i++) {
+    if ((pids[i] = fork()) < 0) {
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if (pids[i] == 0) {
+      close(gate[1]);
+      read(gate[0], &c, 1);
+      for (t = uptime(); uptime() < t + 15;)
+        ;
+      exit(0);
+    }
+  }
+  ga = sched_setgroup(pids[0], -1);
+  gb = sched_setgroup(pids[1], -1);
+  if (ga < 0 || gb < 0 || sched_setgroup(pids[2], gb) != gb || sched_setgroup(pids[3], gb) != gb ||
+      sched_setshare(ga, 100) < 0 || sched_setshare(gb, 100) < 0) {
+    printf("%s: setgroup failed\n", s);
+    exit(1);
+  }
+  close(gate[1]);
+  sleep(10);
+  if (stats(&st) < 0) {
+    printf("%s: stats failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < 4; i++) wait(0);
+
+  a = st.group[ga].runtime;
+  b = st.group[gb].runtime;
+  if (st.group[ga].nproc != 1 || st.group[gb].nproc != 3 || a * 2 < b || b * 2 < a) {
+    printf("%s: group %d got %d ms, group %d got %d ms\n", s, ga, (int)(a / (TIMEFREQ / 1000)), gb,
+           (int)(b / (TIMEFREQ / 1000)));
+    exit(1);
+  }
+}
+
+// a real-time process gets its budget, and no more, on a hart
+// it shares with an ordinary spinner; admission turns away
+// more than a hart can give.
+void rttest(char *s) {
+  static struct stats st;
+  struct rusage ru;
+  uint64 all, used;
+  int i, t, rtutil, pid, spinner, xstatus;
+
+  if (stats(&st) < 0 || sched_getaffinity(0, &all) < 0) {
+    printf("%s: stats failed\n", s);
+    exit(1);
+  }
+  rtutil = st.rtutil;
+  if (sched_setrt(0, 20000, 20000) == 0 || sched_setrt(0, 20000, 0) == 0 || sched_setrt(0, 0, 0) < 0) {
+    printf("%s: bad admission\n", s);
+    exit(1);
+  }
+  for (i = NCPU - 1; (all & (1UL << i)) == 0; i--)
+    ;
+  if (sched_setaffinity(0, 1UL << i) < 0) {
+    printf("%s: setaffinity failed\n", s);
+    exit(1);
+  }
+  if ((spinner = fork()) == 0) {
+    for (;;)
+      ;
+  }
+  if ((pid = fork()) == 0) {
+    // 5 ms of every 20 ms.
+    if (sched_setrt(0, 20000, 5000) < 0) {
+      printf("%s: setrt failed\n", s);
+      exit(1);
+    }
+    for (t = uptime(); uptime() < t + 20;)
+      ;
+    getrusage(RUSAGE_SELF, &ru);
+    used = ru.utime + ru.stime;
+    if (used < TIMEFREQ * 3 / 10 || used > TIMEFREQ * 8 / 10) {
+      printf("%s: got %d ms of 2000 ms\n", s, (int)(used / (TIMEFREQ / 1000)));
+      exit(1);
+    }
+    exit(0);
+  }
+  if (spinner < 0 || pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  // the spinner never exits by itself.
+  wait(&xstatus);
+  kill(spinner);
+  wait(0);
+  if (xstatus != 0) exit(xstatus);
+  if (stats(&st) < 0 || st.rtutil != rtutil) {
+    printf("%s: real-time share not given back\n", s);
+    exit(1);
+  }
+}
+
+// the free blocks add up to the free pages, and memory a
+// child used comes back merged into big blocks when it exits.
+void buddytest(char *s) {
+  static struct stats st;
+  uint pages, big, i;
+  int k, pid, xstatus;
+  char *a;
+
+  if (stats(&st) < 0) {
+    printf("%s: stats failed\n", s);
+    exit(1);
+  }
+  for (pages = 0, k = 0; k <= KMAXORDER; k++) pages += st.freeblocks[k] << k;
+  if (pages != st.freepages) {
+    printf("%s: blocks hold %d pages, not %d\n", s, pages, st.freepages);
+    exit(1);
+  }
+  big = st.freeblocks[KMAXORDER];
+
+  // scatter a child over half of free memory; sbrk() only
+  // reserves it, so touch every page.
+  if ((pid = fork()) == 0) {
+    if ((a = sbrk(st.freepages / 2 * PGSIZE)) == (char *)-1) exit(1);
+    for (i = 0; i < st.freepages / 2; i++) a[i * PGSIZE] = 1;
+    exit(0);
+  }
+  if (pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if (xstatus != 0) {
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  if (stats(&st) < 0 || st.freeblocks[KMAXORDER] + 1 < big) {
+    printf("%s: %d big blocks before, %d after\n", s, big, st.freeblocks[KMAXORDER]);
+    exit(1);
+  }
+}
+
+// reading memory never written maps the zero page, which takes
+// no memory; the first write gets a page of its own, and fork()
+// shares the rest.
+void zeropagetest(char *s) {
+  enum { N = 256 };
+  static struct stats st;
+  uint rss;
+  char *a;
+  int i, pid, xstatus;
+
+  if ((a = sbrk(N * PGSIZE)) == (char *)-1 || stats(&st) < 0) {
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  rss = st.rsspages;
+  for (i = 0; i < N; i++) {
+    if (a[i * PGSIZE] != 0 || a[i * PGSIZE + PGSIZE - 1] != 0) {
+      printf("%s: new memory not zero\n", s);
+      exit(1);
+    }
+  }
+  if (stats(&st) < 0 || st.rsspages > rss + 8) {
+    printf("%s: reading %d pages took %d\n", s, N, st.rsspages - rss);
+    exit(1);
+  }
+  rss = st.rsspages;
+  for (i = 0; i < N; i += 2) a[i * PGSIZE] = 1;
+  if (stats(&st) < 0 || st.rsspages < rss + N / 2) {
+    printf("%s: writing %d pages took %d\n", s, N / 2, st.rsspages - rss);
+    exit(1);
+  }
+
+  if ((pid = fork()) == 0) {
+    for (i = 0; i < N; i++) {
+      if (a[i * PGSIZE] != (i % 2 == 0) || a[i * PGSIZE + 1] != 0) exit(1);
+      a[i * PGSIZE + 1] = 2;
+    }
+    exit(0);
+  }
+  if (pid < 0) {
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  for (i = 0; i < N; i++) {
+    if (xstatus != 0 || a[i * PGSIZE + 1] != 0) {
+      printf("%s: child saw or changed the wrong memory\n", s);
+      exit(1);
+    }
+  }
+  sbrk(-N * PGSIZE);
+}
+
+// sbrk() and fork() respect RLIMIT_RSS.
+void rlimittest(char *s) {
+  struct rlimit rl;
+  struct rusage ru;
+  int i, j, pid, xstatus;
+  char *a;
+
+  if (getrlimit(RLIMIT_RSS, &rl) < 0 || rl.cur != RLIM_INFINITY || rl.max != RLIM_INFINITY) {
+    printf("%s: default limit is not infinite\n", s);
+    exit(1);
+  }
+  if (getrusage(RUSAGE_SELF, &ru) < 0 || ru.maxrss == 0) {
+    printf("%s: no maxrss\n", s);
+    exit(1);
+  }
+
+  // maxrss is at least what we hold now.
+  rl.cur = (ru.maxrss + 16) * PGSIZE;
+  if (setrlimit(RLIMIT_RSS, &rl) < 0) {
+    printf("%s: setrlimit failed\n", s);
+    exit(1);
+  }
+  if (sbrk(4 * PGSIZE) == (char *)-1) {
+    printf("%s: sbrk under the limit failed\n", s);
+    exit(1);
+  }
+  if (sbrk(64 * PGSIZE) != (char *)-1) {
+    printf("%s: sbrk over the limit succeeded\n", s);
+    exit(1);
+  }
+
+  // nor can memory reserved in small steps all be written; a
+  // write over the limit kills the process.
+  if ((pid = fork()) == 0) {
+    for (i = 0; i < 8; i++) {
+      if ((a = sbrk(12 * PGSIZE)) == (char *)-1) exit(0);
+      for (j = 0; j < 12; j++) a[j * PGSIZE] = 1;
+    }
+    exit(1);
+  }
+  wait(&xstatus);
+  if (pid < 0 || xstatus == 1) {
+    printf("%s: wrote past the limit\n", s);
+    exit(1);
+  }
+
+  // a limit below what we hold already stops fork() too.
+  rl.cur = PGSIZE;
+  if (setrlimit(RLIMIT_RSS, &rl) < 0) {
+    printf("%s: setrlimit failed\n", s);
+    exit(1);
+  }
+  if (sbrk(PGSIZE) != (char *)-1 || fork() >= 0) {
+    printf("%s: sbrk or fork over the limit succeeded\n", s);
+    exit(1);
+  }
+
+  // max can come down, but not go back up.
+  rl.max = rl.cur;
+  if (setrlimit(RLIMIT_RSS, &rl) < 0) {
+    printf("%s: lowering max failed\n", s);
+    exit(1);
+  }
+  rl.cur = rl.max = RLIM_INFINITY;
+  if (setrlimit(RLIMIT_RSS, &rl) >= 0) {
+    printf("%s: raising max succeeded\n", s);
+    exit(1);
+  }
+}
+
+// memory held by unreaped zombies is reclaimed rather than
+// making allocations fail.
+void reclaimtest(char *s) {
+  struct stats st, now;
+  int i, pid, xstatus;
+  uint64 got, off, chunk = 16 * PGSIZE;
+  char *a;
+
+  for (i = 0; i < 4; i++) {
+    pid = fork();
+    if (pid < 0) {
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if (pid == 0) {
+      // sbrk() only reserves memory; write it all.
+      if ((a = sbrk(4 << 20)) == (char *)-1) exit(1);
+      for (off = 0; off < (4 << 20); off += PGSIZE) a[off] = 1;
+      exit(0);
+    }
+  }
+  sleep(5);
+
+  // the zombies' 16MB (4096 pages) is not yet free.
+  if (stats(&st) < 0) {
+    printf("%s: stats failed\n", s);
+    exit(1);
+  }
+  // write every page, and stop while a chunk still fits, not
+  // to be killed by a fault that finds no memory. reclaim may
+  // lag a tick behind.
+  for (got = 0;; got += chunk) {
+    if (stats(&now) < 0) break;
+    if (now.freepages < 2 * chunk / PGSIZE) {
+      sleep(1);
+      if (stats(&now) < 0 || now.freepages < 2 * chunk / PGSIZE) break;
+    }
+    if ((a = sbrk(chunk)) == (char *)-1) break;
+    for (off = 0; off < chunk; off += PGSIZE) a[off] = 1;
+  }
+  sbrk(-got);
+  if (got < (st.freepages + 2048) * PGSIZE) {
+    printf("%s: got %d pages, %d were free\n", s, (int)(got / PGSIZE), (int)st.freepages);
+    exit(1);
+  }
+
+  for (i = 0; i < 4; i++) {
+    if (wait(&xstatus) < 0 || xstatus != 0) {
+      printf("%s: child failed\n", s);
+      exit(1);
+    }
+  }
+}
+
+// path names at every alignment, and straddling a page
+// boundary, must reach the kernel intact.
+void pathcopytest(char *s) {
+  static char names[64];
+  char *top, *name;
+  int off, fd;
+
+  for (off = 0; off < 16; off++) {
+    name = names + off;
+    strcpy(name, "pathcopy-0123456789abcdef");
+    name[9] = 'a' + off;
+    fd = open(name, O_CREATE | O_RDWR);
+    if (fd < 0) {
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+    if (unlink(name) < 0) {
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  top = sbrk(3 * PGSIZE);
+  if (top == (char *)-1) {
+    printf("%s: sbrk failed\n", s);
+    exit(1);
+  }
+  for (off = 1; off < 24; off += 5) {
+    name = (char *)PGROUNDUP((uint64)top) + PGSIZE - off;
+    strcpy(name, "pathcopy-straddle");
+    fd = open(name, O_CREATE | O_RDWR);
+    if (fd < 0) {
+      printf("%s: create %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+    if (unlink("pathcopy-straddle") < 0) {
+      printf("%s: unlink straddling name failed\n", s);
+      exit(1);
+    }
+  }
+}
+
 // simple fork and pipe read/write
 
 void pipe1(char *s) {
@@ -692,6 +1429,60 @@ void pipe1(char *s) {
   }
 }
 
+// system calls that sleep, on the fast path, must come back
+// with their registers while spinning processes take timer
+// interrupts, and are switched out, on the full path.
+void syscallsleep(char *s) {
+  enum { NSPIN = 3, NREAD = 3, N = 10 };
+  int fds[2], spin[NSPIN], i, j, pid, xstatus;
+  char c;
+
+  if (pipe(fds) < 0) {
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  for (i = 0; i < NSPIN; i++) {
+    if ((spin[i] = fork()) == 0)
+      for (;;)
+        ;
+    if (spin[i] < 0) {
+      printf("%s: fork() failed\n", s);
+      exit(1);
+    }
+  }
+  for (i = 0; i < NREAD; i++) {
+    if ((pid = fork()) == 0) {
+      for (j = 0; j < N; j++) {
+        sleep(1);
+        if (read(fds[0], &c, 1) != 1 || c != 'x') exit(1);
+      }
+      exit(0);
+    }
+    if (pid < 0) {
+      printf("%s: fork() failed\n", s);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  for (j = 0; j < NREAD * N; j++) {
+    sleep(1);
+    if (write(fds[1], "x", 1) != 1) {
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  close(fds[1]);
+  for (i = 0; i < NREAD; i++) {
+    wait(&xstatus);
+    if (xstatus != 0) {
+      printf("%s: a sleeping system call came back wrong\n", s);
+      exit(1);
+    }
+  }
+  for (i = 0; i < NSPIN; i++) kill(spin[i]);
+  for (i = 0; i < NSPIN; i++) wait(0);
+}
+
 // meant to be run w/ at most two CPUs
 void preempt(char *s) {
   int pid1, pid2, pid3;
@@ -2513,6 +3304,20 @@ int main(int argc, char *argv[]) {
       {fourfiles, "fourfiles"},
       {sharedfd, "sharedfd"},
       {exectest, "exectest"},
+      {spawntest, "spawntest"},
+      {wctest, "wctest"},
+      {irqtest, "irqtest"},
+      {rusagetest, "rusagetest"},
+      {statstest, "statstest"},
+      {dmesgtest, "dmesgtest"},
+      {pathcopytest, "pathcopytest"},
+      {reclaimtest, "reclaimtest"},
+      {rlimittest, "rlimittest"},
+      {affinitytest, "affinitytest"},
+      {grouptest, "grouptest"},
+      {rttest, "rttest"},
+      {buddytest, "buddytest"},
+      {zeropagetest, "zeropagetest"},
       {bigargtest, "bigargtest"},
       {bigwrite, "bigwrite"},
       {bsstest, "bsstest"},
@@ -2533,6 +3338,7 @@ int main(int argc, char *argv[]) {
       {mem, "mem"},
       {pipe1, "pipe1"},
       {preempt, "preempt"},
+      {syscallsleep, "syscallsleep"},
       {exitwait, "exitwait"},
       {rmdot, "rmdot"},
       {fourteen, "fourteen"},
@@ -36,3 +36,18 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("spawn");
+entry("irqaffinity");
+entry("irqstat");
+entry("getrusage");
+entry("stats");
+entry("dmesg");
+entry("getrlimit");
+entry("setrlimit");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("sched_isolate");
+entry("sched_settickets");
+entry("sched_setgroup");
+entry("sched_setshare");
+entry("sched_setrt");
@@ -0,0 +1,119 @@
+// xargs [-n maxargs] [-P maxprocs] command [args...]
+//
+// Read whitespace-separated words from standard input and run
+// command with the given args followed by as many words as fit
+// (at most maxargs, and at most MAXARG-1 in all). Up to maxprocs
+// commands run at once; each is reaped as soon as one exits.
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "user/user.h"
+
+char ibuf[2048];               // a chunk of standard input
+char abuf[MAXARG * MAXPATH];   // words of the pending command
+char *args[MAXARG];            // argv of the pending command, 0-terminated
+int nfixed;                    // command and its own args in args[]
+int nargs;                     // args[] in use
+int maxargs = MAXARG - 1;      // words per command, plus nfixed
+int maxprocs = 1;              // commands running at once
+int running;                   // commands not yet reaped
+int failed;                    // some command exited non-zero
+
+void usage(void) {
+  fprintf(2, "usage: xargs [-n maxargs] [-P maxprocs] command [args...]\n");
+  exit(1);
+}
+
+// Wait for one running command.
+void reap(void) {
+  int status;
+
+  if (wait(&status) < 0) return;
+  running--;
+  if (status != 0) failed = 1;
+}
+
+// Start the pending command, if it has any words.
+void run(void) {
+  int pid;
+
+  if (nargs == nfixed) return;
+  if (running == maxprocs) reap();
+
+  args[nargs] = 0;
+  pid = fork();
+  if (pid < 0) {
+    fprintf(2, "xargs: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    exec(args[0], args);
+    fprintf(2, "xargs: exec %s failed\n", args[0]);
+    exit(1);
+  }
+  running++;
+
+  // The child has its own copy of abuf, so start over.
+  nargs = nfixed;
+}
+
+int main(int argc, char *argv[]) {
+  int i, n, inword;
+  char *p, *w;
+
+  for (i = 1; i + 1 < argc && argv[i][0] == '-'; i += 2) {
+    if (strcmp(argv[i], "-n") == 0)
+      maxargs = atoi(argv[i + 1]);
+    else if (strcmp(argv[i], "-P") == 0)
+      maxprocs = atoi(argv[i + 1]);
+    else
+      usage();
+  }
+  if (i >= argc || maxprocs < 1 || maxargs < 1) usage();
+
+  for (; i < argc; i++) {
+    if (nfixed >= MAXARG - 2) {
+      fprintf(2, "xargs: too many args\n");
+      exit(1);
+    }
+    args[nfixed++] = argv[i];
+  }
+  if (maxargs > MAXARG - 1 - nfixed) maxargs = MAXARG - 1 - nfixed;
+  nargs = nfixed;
+
+  // Copy each word into abuf as it is scanned, since a word
+  // may straddle two reads.
+  inword = 0;
+  w = p = abuf;
+  while ((n = read(0, ibuf, sizeof(ibuf))) > 0) {
+    for (i = 0; i < n; i++) {
+      char c = ibuf[i];
+      if (c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v') {
+        if (!inword) continue;
+        *p++ = 0;
+        args[nargs++] = w;
+        inword = 0;
+        if (nargs - nfixed == maxargs) {
+          run();
+          p = abuf;
+        }
+        w = p;
+        continue;
+      }
+      if (p - w >= MAXPATH - 1) {
+        fprintf(2, "xargs: argument too long\n");
+        exit(1);
+      }
+      *p++ = c;
+      inword = 1;
+    }
+  }
+  if (inword) {
+    *p = 0;
+    args[nargs++] = w;
+  }
+  run();
+
+  while (running > 0) reap();
+  exit(failed);
+}